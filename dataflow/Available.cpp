@@ -1,7 +1,54 @@
-#include "Dataflow.h"
+#include "Cache.h"
+#include "Emitter.h"
+#include "Solver.h"
 
 using namespace llvm;
 namespace {
+    class AvailableTransfer : public GenKillTransfer<AvailableTransfer> {
+        public:
+        AvailableTransfer (const ExpressionTable &table)
+            : GenKillTransfer(table.domain()), table(table) {}
+
+        BlockSummary summarize (BasicBlock *curr) {
+            BlockSummary output;
+            VSet &gen = output.gen, &kill = output.kill;
+
+            gen = emptySet();
+            kill = emptySet();
+            for (auto inst = curr->begin(); inst != curr->end(); ++inst) {
+                // a store redefines its pointer, anything else itself
+                Value *val = &*inst;
+                if (auto load_ins = dyn_cast<StoreInst>(&*inst)) {
+                    val = load_ins->getPointerOperand();
+                }
+
+                // if it has be re-assigned, kill it
+                if (const VSet *killed = table.users(val)) {
+                    kill |= *killed;
+
+                    // some values are killed in the same Basic Block, so sad
+                    gen.reset(*killed);
+                }
+
+                // insert to generate set
+                Index i = table.find(&*inst);
+                if (i != INDEX_NOT_FOUND) {
+                    gen.set(i);
+                }
+            }
+
+            return output;
+        }
+
+        // the expression table is part of what the analysis keeps
+        size_t bytesUsed () const {
+            return GenKillTransfer::bytesUsed() + table.bytesUsed();
+        }
+
+        private:
+        const ExpressionTable &table;
+    };
+
     class Available : public FunctionPass {
         public:
         static char ID;
@@ -12,147 +59,80 @@ namespace {
 
         Available() : FunctionPass(ID) {}
 
-        virtual bool runOnFunction(Function &F) {
-            outs() << "Function: " << F.getName() << "\n";
-            DataFlowResult result;
-            Domain domain;
-
-            // we only evaluate Expressions
-            for (auto I = inst_begin(F); I != inst_end(F); ++I) {
-                if (isa<BinaryOperator> (*I)) {
-                    domain.push_back(new Expression(&*I));
-                }
-            }
-
-            Analysis analysis = Analysis(Direction::FORWARD, MeetOp::INTERSECT,  domain);
-            result = analysis.run(F, VSet(), VSet());
-
-            // output the result
-            int index = 0;
-            for (auto &BB : F) {
-                outs() << "\n<" << BB.getName() << ">\n";
-                VSet gen = result.result[&BB].in;
-                for (auto &I : BB) {
-                    outs() << index << ": " << I;
-
-                    std::string val = getValueName(&I);
-                    
-                    // killed redefined expressions
-                    auto tmp = gen.end();
-                    for (auto i = gen.begin(); i != gen.end(); ++i) {
-                        if (tmp != gen.end()) {
-                            gen.erase(tmp);
-                            tmp = gen.end();
-                        }
-                        Expression* exp = (Expression *) domain[*i];
-                        std::string left = getValueName(exp->v1), right = getValueName(exp->v2);                        
-                        if (left == val || right == val) {
-                            tmp = i;
-                        }
-                    }
-                    
-                    // insert expressions
-                    if (isa<BinaryOperator> (&I)) {
-                        Expression exp = Expression(&I);
-                        int i = 0;
-                        for (auto e : domain) {
-                            if (exp == *(Expression *)(e)) {
-                                break;
-                            }
-                            i++;
-                        }
-                        gen.insert(i);
-                    }
-                    
-                    // pretty print
-                    outs() << "\t{";
-                    for (auto i : gen) {
-                        outs() << ((Expression *) domain[i])->toString() << ", ";
-                    }
-                    outs() << "}\n";
-
-                    index++;
-                }    
-            }
-            // clean up
-            for (auto exp : domain) {
-                delete (Expression *) exp;
-            }
+        virtual bool doInitialization (Module &M) {
+            namer.reset(new ValueNamer(&M));
+            return false;
+        }
 
+        virtual bool runOnFunction(Function &F) {
+            printAvailable(F, resultStream(), *namer);
             return false;
         }
 
         private:
-        class Analysis : public Dataflow {
-            public:
-            Analysis (Direction direction, MeetOp meetop, Domain domain)
-                : Dataflow (direction, meetop, domain) {}
-            
-            TransferOutput transferFn (VSet input, BasicBlock *curr) {
-                TransferOutput output;
-                VSet gen, kill;
-                for (auto inst = curr->begin(); inst != curr->end(); ++inst) {
-                    std::string val;
-                    if (isa<Instruction> (&*inst)) {
-                        val = getValueName(&*inst);
-                    }
-
-                    if (auto load_ins = dyn_cast<StoreInst>(&*inst)) {
-                        val = getValueName(load_ins->getPointerOperand());
-                    }
-                    
-                    // skip if it's not a value
-                    if (val == "") {
-                        continue;
-                    }
-
-                    // if input has be re-assigned, kill it
-                    for (auto LHS : input) {
-                        Expression* exp = (Expression *) domain[LHS];
-                        std::string left = getValueName(exp->v1), right = getValueName(exp->v2);
-                        if (left == val || right == val) {
-                            kill.insert(LHS);
-                        }    
-                    }
-
-                    // some values are killed in the same Basic Block, so sad
-                    auto tmp = gen.end();
-                    for (auto i = gen.begin(); i != gen.end(); ++i) {
-                        if (tmp != gen.end()) {
-                            gen.erase(tmp);
-                            tmp = gen.end();
-                        }
-                        Expression* exp = (Expression *) domain[*i];
-                        std::string left = getValueName(exp->v1), right = getValueName(exp->v2);                        
-                        if (left == val || right == val) {
-                            tmp = i;
-                        }
-                    }
-
-                    // insert to generate set
-                    if (isa<BinaryOperator> (&*inst)) {
-                        Expression exp = Expression(&*inst);
-                        int i = 0;
-                        for (auto e : domain) {
-                            if (exp == *(Expression *)(e)) {
-                                break;
-                            }
-                            i++;
-                        }
-
-                        if (i < domain.size()) {
-                            gen.insert(i);
-                        }
-                    }
-                }
-
-                auto tmp = substractSet(input, kill);
-                output.transfer = unionSet(tmp, gen);
-                return output;
-            }
-        };
+        std::unique_ptr<ValueNamer> namer;
     };
 
     char Available::ID = 0;
     RegisterPass<Available> X("available", "Available Expression");
-}
\ No newline at end of file
+}
+
+namespace llvm {
+    AnalysisKey AvailableAnalysis::Key;
+
+    AvailableInfo computeAvailable (Function &F) {
+        DataFlowResult result;
+        ExpressionTable table;
+        PhaseTimer domainTimer("available", "domain", F);
+
+        // we only evaluate Expressions
+        for (auto I = inst_begin(F); I != inst_end(F); ++I) {
+            if (isa<BinaryOperator> (*I)) {
+                table.insert(&*I);
+            }
+        }
+        domainTimer.stop();
+
+        // expressions are not values of F, the table is rebuilt either way
+        // and only the sets come from the cache
+        CachedResult cached(F, "available");
+        if (cached.load(result, table.size())) {
+            return AvailableInfo(std::move(table), std::move(result));
+        }
+
+        // nothing is available at entry, interior blocks start from top
+        AvailableTransfer transfer(table);
+        DataflowSolver<FORWARD, IntersectMeet, AvailableTransfer> analysis(transfer, WORKLIST, "available");
+        result = analysis.run(F, transfer.emptySet(), transfer.fullSet());
+        cached.store(result, table.size());
+
+        return AvailableInfo(std::move(table), std::move(result));
+    }
+
+    void printAvailable (Function &F, raw_ostream &OS, ValueNamer &namer) {
+        computeAvailable(F).print(F, OS, namer);
+    }
+
+    // forward over one instruction, same as the block summary
+    void AvailableInfo::step (const Instruction &I, VSet &available) const {
+        const Value *val = &I;
+        if (auto store = dyn_cast<StoreInst>(&I)) {
+            val = store->getPointerOperand();
+        }
+
+        // killed redefined expressions
+        if (const VSet *killed = table.users(val)) {
+            available.reset(*killed);
+        }
+
+        // insert expressions
+        Index i = table.find(&I);
+        if (i != Domain::NOT_FOUND) {
+            available.set(i);
+        }
+    }
+
+    void AvailableInfo::print (Function &F, raw_ostream &OS, ValueNamer &namer) const {
+        ResultEmitter(OS, namer).emit(F, *this);
+    }
+}
@@ -0,0 +1,196 @@
+#include "Emitter.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <atomic>
+#include <mutex>
+
+using namespace llvm;
+namespace {
+    enum AnalysisKind {
+        LIVENESS,
+        REACHING,
+        AVAILABLE,
+        CONSTANTS
+    };
+
+    static cl::list<std::string> Inputs(cl::Positional, cl::ZeroOrMore,
+        cl::desc("<input .bc/.ll files>"));
+
+    static cl::opt<std::string> InputList("list",
+        cl::desc("Also analyze every file named in this file, one path per line"),
+        cl::value_desc("file"));
+
+    static cl::list<AnalysisKind> Analyses("analysis", cl::CommaSeparated,
+        cl::desc("Analyses run on every function, in this order (default liveness)"),
+        cl::values(
+            clEnumValN(LIVENESS, "liveness", "Liveness Analysis"),
+            clEnumValN(REACHING, "reaching", "Reaching Definition"),
+            clEnumValN(AVAILABLE, "available", "Available Expression"),
+            clEnumValN(CONSTANTS, "constants", "Constant Propagation")));
+
+    static cl::list<std::string> Only("function", cl::CommaSeparated,
+        cl::desc("Only analyze these functions, the others are never read"),
+        cl::value_desc("name"));
+
+    static cl::opt<unsigned> Threads("j",
+        cl::desc("Files analyzed at once, 0 uses every core"),
+        cl::init(0));
+
+    // bitcode is mapped without a terminator so large files are never
+    // copied, text IR needs one and gets a copy
+    Expected<std::unique_ptr<MemoryBuffer>> mapFile (const std::string &path) {
+        auto buffer = MemoryBuffer::getFileOrSTDIN(path, false, false);
+        if (!buffer) {
+            return errorCodeToError(buffer.getError());
+        }
+
+        std::unique_ptr<MemoryBuffer> file = std::move(*buffer);
+        StringRef data = file->getBuffer();
+        if (isBitcode(data.bytes_begin(), data.bytes_end())) {
+            return file;
+        }
+        return MemoryBuffer::getMemBufferCopy(data, file->getBufferIdentifier());
+    }
+
+    bool selected (const Function &F) {
+        if (F.isDeclaration() && !F.isMaterializable()) {
+            return false;
+        }
+        return Only.empty() || is_contained(Only, F.getName());
+    }
+
+    // analyze one file into OS. Function bodies are read from the bitcode
+    // one at a time, right before they are analyzed, and dropped after, so
+    // a file never holds more than one body in memory
+    bool analyzeFile (const std::string &path, ArrayRef<AnalysisKind> analyses,
+        raw_ostream &OS, raw_ostream &errors) {
+        auto buffer = mapFile(path);
+        if (!buffer) {
+            errors << path << ": " << toString(buffer.takeError()) << "\n";
+            return false;
+        }
+
+        LLVMContext context;
+        SMDiagnostic err;
+        std::unique_ptr<Module> M = getLazyIRModule(std::move(*buffer), err, context);
+        if (!M) {
+            err.print("dataflow-batch", errors);
+            return false;
+        }
+
+        ValueNamer namer(M.get());
+        ResultEmitter(OS, namer).beginFile(path);
+        for (auto &F : *M) {
+            if (!selected(F)) {
+                continue;
+            }
+            if (Error E = F.materialize()) {
+                errors << path << ": " << F.getName() << ": " << toString(std::move(E)) << "\n";
+                return false;
+            }
+
+            for (auto analysis : analyses) {
+                switch (analysis) {
+                    case LIVENESS:
+                        printLiveness(F, OS, namer);
+                        break;
+                    case REACHING:
+                        printReaching(F, OS, namer);
+                        break;
+                    case AVAILABLE:
+                        printAvailable(F, OS, namer);
+                        break;
+                    case CONSTANTS:
+                        printConstants(F, OS, namer);
+                        break;
+                }
+            }
+            F.deleteBody();
+        }
+        return true;
+    }
+
+    std::vector<std::string> inputFiles () {
+        std::vector<std::string> files(Inputs.begin(), Inputs.end());
+        if (InputList.empty()) {
+            return files;
+        }
+
+        auto list = MemoryBuffer::getFileOrSTDIN(InputList);
+        if (!list) {
+            error("can not read " + InputList + ": " + list.getError().message());
+        }
+        for (line_iterator line(**list, true, '#'); !line.is_at_end(); ++line) {
+            StringRef path = line->trim();
+            if (!path.empty()) {
+                files.push_back(path.str());
+            }
+        }
+        return files;
+    }
+}
+
+// dataflow-batch: run analyses over many IR files in one process, without
+// opt or its pipeline. Files are analyzed in parallel and written to
+// -dataflow-output in the order given, each behind a File: line (or record)
+int main (int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "dataflow batch analysis\n");
+
+    std::vector<std::string> files = inputFiles();
+    if (files.empty()) {
+        errs() << argv[0] << ": no input files\n";
+        return 1;
+    }
+    std::vector<AnalysisKind> analyses(Analyses.begin(), Analyses.end());
+    if (analyses.empty()) {
+        analyses.push_back(LIVENESS);
+    }
+    if (is_contained(analyses, CONSTANTS) && !canEmitConstants(argv[0])) {
+        return 1;
+    }
+
+    // the same ordered streaming as -dataflow-module, one file per buffer
+    std::vector<std::string> output(files.size()), errors(files.size());
+    std::vector<bool> done(files.size());
+    std::atomic<unsigned> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex writing;
+    unsigned written = 0;
+
+    ThreadPool pool(hardware_concurrency(Threads));
+    for (unsigned t = 0; t < pool.getThreadCount(); ++t) {
+        pool.async([&]() {
+            for (unsigned i = next++; i < files.size(); i = next++) {
+                raw_string_ostream OS(output[i]), ES(errors[i]);
+                if (!analyzeFile(files[i], analyses, OS, ES)) {
+                    failed = true;
+                }
+                OS.flush();
+                ES.flush();
+
+                std::lock_guard<std::mutex> lock(writing);
+                done[i] = true;
+                for (; written < files.size() && done[written]; ++written) {
+                    resultStream() << output[written];
+                    errs() << errors[written];
+                    std::string().swap(output[written]);
+                }
+            }
+        });
+    }
+    pool.wait();
+    resultStream().flush();
+
+    return failed ? 1 : 0;
+}
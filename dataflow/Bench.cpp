@@ -0,0 +1,224 @@
+#include "Passes.h"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+
+#include <chrono>
+#include <random>
+
+using namespace llvm;
+namespace {
+    static cl::list<std::string> Inputs(cl::Positional, cl::OneOrMore,
+        cl::desc("<input .ll/.bc files>"));
+
+    static cl::opt<unsigned> Repeat("repeat",
+        cl::desc("Times every function is solved by each engine"),
+        cl::init(10));
+
+    static cl::opt<unsigned> Edits("rerun-edits",
+        cl::desc("Edits of every function after timing, each re-solved incrementally "
+            "and checked against a fresh solve"),
+        cl::init(5));
+
+    // seconds to solve every function of M, Repeat times
+    double timeLiveness (Module &M, LivenessEngine engine) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned r = 0; r < Repeat; ++r) {
+            for (auto &F : M) {
+                if (!F.isDeclaration()) {
+                    computeLiveness(F, engine);
+                }
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    // both engines must agree on every block, or the timing means nothing
+    bool sameLiveness (Function &F) {
+        LivenessInfo iterative = computeLiveness(F, ITERATIVE);
+        LivenessInfo sparse = computeLiveness(F, SPARSE);
+        for (auto &BB : F) {
+            if (iterative.in(&BB) != sparse.in(&BB) || iterative.out(&BB) != sparse.out(&BB)) {
+                errs() << "engines disagree on " << F.getName() << " <" << BB.getName() << ">\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // liveness and the definitions reaching a block, as gen/kill problems on
+    // the virtual interface rerun is offered through, one per direction
+    class EditedLiveness : public Dataflow {
+        public:
+        EditedLiveness (Domain domain) : Dataflow(BACKWARD, UNION, domain) {}
+
+        BlockSummary summarize (BasicBlock *BB) {
+            BlockSummary summary;
+            summary.gen = summary.kill = emptySet();
+            for (auto &I : *BB) {
+                if (auto phi = dyn_cast<PHINode>(&I)) {
+                    for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i) {
+                        Index v = domainIndex(phi->getIncomingValue(i));
+                        if (v != INDEX_NOT_FOUND) {
+                            BasicBlock *incoming = phi->getIncomingBlock(i);
+                            summary.neighbor.insert(std::make_pair(incoming, emptySet()));
+                            summary.neighbor[incoming].set(v);
+                        }
+                    }
+                } else {
+                    for (auto &op : I.operands()) {
+                        Index v = domainIndex(op.get());
+                        if (v != INDEX_NOT_FOUND && !summary.kill.test(v)) {
+                            summary.gen.set(v);
+                        }
+                    }
+                }
+                Index v = domainIndex(&I);
+                if (v != INDEX_NOT_FOUND) {
+                    summary.kill.set(v);
+                }
+            }
+            return summary;
+        }
+    };
+
+    class EditedDefinitions : public Dataflow {
+        public:
+        EditedDefinitions (Domain domain) : Dataflow(FORWARD, UNION, domain) {}
+
+        BlockSummary summarize (BasicBlock *BB) {
+            BlockSummary summary;
+            summary.gen = summary.kill = emptySet();
+            for (auto &I : *BB) {
+                Index v = domainIndex(&I);
+                if (v != INDEX_NOT_FOUND) {
+                    summary.gen.set(v);
+                }
+            }
+            return summary;
+        }
+    };
+
+    // one edit of F: a new use of an argument in some block, or a
+    // conditional branch that drops one of its targets. Returns the blocks
+    // whose instructions changed, the new instruction goes into domain
+    std::set<BasicBlock*> edit (Function &F, Domain &domain, std::mt19937 &rng) {
+        std::vector<BasicBlock*> blocks;
+        std::vector<BranchInst*> branches;
+        for (auto &BB : F) {
+            blocks.push_back(&BB);
+            auto branch = dyn_cast<BranchInst>(BB.getTerminator());
+            if (branch && branch->isConditional() && branch->getSuccessor(0) != branch->getSuccessor(1)) {
+                branches.push_back(branch);
+            }
+        }
+        Argument *arg = nullptr;
+        for (auto &A : F.args()) {
+            if (A.getType()->isIntegerTy()) {
+                arg = &A;
+            }
+        }
+
+        std::set<BasicBlock*> changed;
+        if (arg && (branches.empty() || rng() % 2)) {
+            BasicBlock *BB = blocks[rng() % blocks.size()];
+            IRBuilder<> builder(BB->getTerminator());
+            domain.insert(builder.CreateAdd(arg, ConstantInt::get(arg->getType(), 1)));
+            changed.insert(BB);
+        } else if (!branches.empty()) {
+            BranchInst *branch = branches[rng() % branches.size()];
+            BasicBlock *BB = branch->getParent();
+            unsigned dropped = rng() % 2;
+            BasicBlock *target = branch->getSuccessor(dropped);
+            // the dropped target is only edited if it has PHIs to update,
+            // otherwise it just lost a predecessor
+            if (isa<PHINode>(target->front())) {
+                changed.insert(target);
+            }
+            target->removePredecessor(BB, true);
+            BranchInst::Create(branch->getSuccessor(1 - dropped), branch);
+            branch->eraseFromParent();
+            changed.insert(BB);
+        }
+        return changed;
+    }
+
+    // an incremental re-solve after every edit has to match a fresh solve
+    template<typename Analysis> bool sameRerun (Function &F, std::mt19937 &rng) {
+        Domain domain;
+        for (auto &arg : F.args()) {
+            domain.insert(&arg);
+        }
+        for (auto &I : instructions(F)) {
+            domain.insert(&I);
+        }
+
+        Analysis incremental(domain);
+        DataFlowResult result = incremental.run(F, incremental.emptySet(), incremental.emptySet());
+        for (unsigned e = 0; e < Edits; ++e) {
+            std::set<BasicBlock*> changed = edit(F, incremental.domain, rng);
+            result = incremental.rerun(F, result, changed, incremental.emptySet(), incremental.emptySet());
+
+            Analysis fresh(incremental.domain);
+            DataFlowResult expected = fresh.run(F, fresh.emptySet(), fresh.emptySet());
+            for (auto &BB : F) {
+                if (result.at(&BB).in != expected.at(&BB).in || result.at(&BB).out != expected.at(&BB).out) {
+                    errs() << "rerun and fresh solve disagree on " << F.getName()
+                        << " <" << BB.getName() << "> after " << e + 1 << " edits\n";
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+// dataflow-bench: time the liveness engines over the functions of each input
+int main (int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "dataflow engine benchmark\n");
+
+    LLVMContext context;
+    bool agree = true;
+    outs() << "file\tfunctions\tblocks\titerative(s)\tsparse(s)\tspeedup\n";
+    for (auto &input : Inputs) {
+        SMDiagnostic err;
+        std::unique_ptr<Module> M = parseIRFile(input, err, context);
+        if (!M) {
+            err.print(argv[0], errs());
+            return 1;
+        }
+
+        unsigned functions = 0, blocks = 0;
+        for (auto &F : *M) {
+            if (!F.isDeclaration()) {
+                functions++;
+                blocks += F.size();
+                agree &= sameLiveness(F);
+            }
+        }
+
+        double iterative = timeLiveness(*M, ITERATIVE);
+        double sparse = timeLiveness(*M, SPARSE);
+        outs() << input << "\t" << functions << "\t" << blocks << "\t"
+            << format("%.6f\t%.6f\t%.2fx\n", iterative, sparse, iterative / sparse);
+
+        // the edits change the module, so they come after the timing
+        std::mt19937 rng(7);
+        for (auto &F : *M) {
+            if (!F.isDeclaration()) {
+                agree &= sameRerun<EditedLiveness>(F, rng);
+                agree &= sameRerun<EditedDefinitions>(F, rng);
+            }
+        }
+    }
+
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+#include "BitKernels.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DATAFLOW_X86_KERNELS
+#endif
+
+namespace llvm {
+    static cl::opt<KernelIsa> Kernels("dataflow-kernels",
+        cl::desc("Instruction set of the bit-set kernels, the best one the host supports by default"),
+        cl::values(
+            clEnumValN(SCALAR, "scalar", "portable word loops"),
+            clEnumValN(SSE2, "sse2", "128-bit SSE2"),
+            clEnumValN(AVX2, "avx2", "256-bit AVX2")));
+
+    namespace {
+        // BitVector::BitWord, which it keeps private
+        typedef decltype(std::declval<const VSet&>().getData())::value_type Word;
+
+        // the raw words of one kernel call. Meet combines inputs into input,
+        // Apply turns input (or the single input) into output
+        struct Words {
+            const Word *const *inputs;
+            unsigned count;
+            const Word *gen, *kill;
+            Word *input, *output;
+            size_t size;
+        };
+
+        template<MeetOp Op, bool Meet, bool Apply>
+        bool scalarKernel (const Words w, size_t from) {
+            Word diff = 0;
+            for (size_t i = from; i < w.size; ++i) {
+                Word m = w.inputs[0][i];
+                for (unsigned n = 1; n < w.count; ++n) {
+                    m = Op == UNION ? m | w.inputs[n][i] : m & w.inputs[n][i];
+                }
+                if (Meet) {
+                    w.input[i] = m;
+                }
+                if (Apply) {
+                    Word o = (m & ~w.kill[i]) | w.gen[i];
+                    diff |= o ^ w.output[i];
+                    w.output[i] = o;
+                }
+            }
+            return diff != 0;
+        }
+
+#ifdef DATAFLOW_X86_KERNELS
+        // the same loops over 128 and 256 bits at a time, the words that do
+        // not fill a register are left to the scalar kernel. Words is taken
+        // by value, so stores through it can not alias its fields
+        template<MeetOp Op, bool Meet, bool Apply>
+        __attribute__((target("sse2")))
+        bool sse2Kernel (const Words w) {
+            const size_t step = sizeof(__m128i) / sizeof(Word);
+            __m128i diff = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + step <= w.size; i += step) {
+                __m128i m = _mm_loadu_si128((const __m128i *) (w.inputs[0] + i));
+                for (unsigned n = 1; n < w.count; ++n) {
+                    __m128i x = _mm_loadu_si128((const __m128i *) (w.inputs[n] + i));
+                    m = Op == UNION ? _mm_or_si128(m, x) : _mm_and_si128(m, x);
+                }
+                if (Meet) {
+                    _mm_storeu_si128((__m128i *) (w.input + i), m);
+                }
+                if (Apply) {
+                    __m128i kill = _mm_loadu_si128((const __m128i *) (w.kill + i));
+                    __m128i gen = _mm_loadu_si128((const __m128i *) (w.gen + i));
+                    __m128i o = _mm_or_si128(_mm_andnot_si128(kill, m), gen);
+                    __m128i old = _mm_loadu_si128((const __m128i *) (w.output + i));
+                    diff = _mm_or_si128(diff, _mm_xor_si128(o, old));
+                    _mm_storeu_si128((__m128i *) (w.output + i), o);
+                }
+            }
+
+            // no ptest before SSE4.1
+            bool changed = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF;
+            bool tail = scalarKernel<Op, Meet, Apply>(w, i);
+            return changed || tail;
+        }
+
+        template<MeetOp Op, bool Meet, bool Apply>
+        __attribute__((target("avx2")))
+        bool avx2Kernel (const Words w) {
+            const size_t step = sizeof(__m256i) / sizeof(Word);
+            __m256i diff = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + step <= w.size; i += step) {
+                __m256i m = _mm256_loadu_si256((const __m256i *) (w.inputs[0] + i));
+                for (unsigned n = 1; n < w.count; ++n) {
+                    __m256i x = _mm256_loadu_si256((const __m256i *) (w.inputs[n] + i));
+                    m = Op == UNION ? _mm256_or_si256(m, x) : _mm256_and_si256(m, x);
+                }
+                if (Meet) {
+                    _mm256_storeu_si256((__m256i *) (w.input + i), m);
+                }
+                if (Apply) {
+                    __m256i kill = _mm256_loadu_si256((const __m256i *) (w.kill + i));
+                    __m256i gen = _mm256_loadu_si256((const __m256i *) (w.gen + i));
+                    __m256i o = _mm256_or_si256(_mm256_andnot_si256(kill, m), gen);
+                    __m256i old = _mm256_loadu_si256((const __m256i *) (w.output + i));
+                    diff = _mm256_or_si256(diff, _mm256_xor_si256(o, old));
+                    _mm256_storeu_si256((__m256i *) (w.output + i), o);
+                }
+            }
+
+            bool changed = !_mm256_testz_si256(diff, diff);
+            // leave the upper halves clean for the SSE code that follows
+            _mm256_zeroupper();
+            bool tail = scalarKernel<Op, Meet, Apply>(w, i);
+            return changed || tail;
+        }
+#endif
+
+        KernelIsa detectIsa () {
+#ifdef DATAFLOW_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return AVX2;
+            }
+            if (__builtin_cpu_supports("sse2")) {
+                return SSE2;
+            }
+#endif
+            return SCALAR;
+        }
+
+        KernelIsa hostIsa () {
+            static const KernelIsa detected = detectIsa();
+            return detected;
+        }
+
+        // set by setKernelIsa, wins over the command line
+        int forcedIsa = -1;
+
+        template<MeetOp Op, bool Meet, bool Apply>
+        bool runKernel (const Words w) {
+            switch (kernelIsa()) {
+#ifdef DATAFLOW_X86_KERNELS
+                case AVX2:
+                    return avx2Kernel<Op, Meet, Apply>(w);
+                case SSE2:
+                    return sse2Kernel<Op, Meet, Apply>(w);
+#endif
+                default:
+                    return scalarKernel<Op, Meet, Apply>(w, 0);
+            }
+        }
+
+        // the kernels write straight into the words of a set. Its size never
+        // changes while they run and the unused bits of the last word stay
+        // clear, every operation keeps zero bits zero
+        Word *words (VSet &set) {
+            return const_cast<Word *>(set.getData().data());
+        }
+
+        // fast paths need every set the same size, a domain that grew since a
+        // summary was built goes through BitVector instead
+        bool sameSize (ArrayRef<const VSet*> inputs, size_t size) {
+            for (auto set : inputs) {
+                if (set->size() != size) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    KernelIsa kernelIsa () {
+        if (forcedIsa >= 0) {
+            return (KernelIsa) forcedIsa;
+        }
+        if (Kernels.getNumOccurrences() && kernelSupported(Kernels)) {
+            return Kernels;
+        }
+        return hostIsa();
+    }
+
+    bool kernelSupported (KernelIsa isa) {
+        return isa <= hostIsa();
+    }
+
+    bool setKernelIsa (KernelIsa isa) {
+        if (!kernelSupported(isa)) {
+            return false;
+        }
+        forcedIsa = isa;
+        return true;
+    }
+
+    const char *kernelName (KernelIsa isa) {
+        switch (isa) {
+            case SSE2:
+                return "sse2";
+            case AVX2:
+                return "avx2";
+            default:
+                return "scalar";
+        }
+    }
+
+    void meetSets (MeetOp op, ArrayRef<const VSet*> inputs, VSet &into) {
+        if (inputs.empty()) {
+            into.reset();
+            return;
+        }
+
+        size_t size = inputs[0]->size();
+        if (!sameSize(inputs, size)) {
+            VSet result = *inputs[0];
+            for (auto set : inputs.drop_front()) {
+                op == UNION ? result |= *set : result &= *set;
+            }
+            into = std::move(result);
+            return;
+        }
+
+        into.resize(size);
+        if (size == 0) {
+            return;
+        }
+
+        SmallVector<const Word*, 8> data;
+        for (auto set : inputs) {
+            data.push_back(set->getData().data());
+        }
+        Words w = {data.data(), (unsigned) data.size(), nullptr, nullptr,
+            words(into), nullptr, into.getData().size()};
+        op == UNION ? runKernel<UNION, true, false>(w) : runKernel<INTERSECT, true, false>(w);
+    }
+
+    bool genKill (const VSet &input, const VSet &gen, const VSet &kill, VSet &output) {
+        size_t size = input.size();
+        if (gen.size() != size || kill.size() != size) {
+            VSet result = input;
+            result.reset(kill);
+            result |= gen;
+            bool changed = result != output;
+            output = std::move(result);
+            return changed;
+        }
+
+        bool resized = output.size() != size;
+        output.resize(size);
+        if (size == 0) {
+            return resized;
+        }
+
+        const Word *data = input.getData().data();
+        Words w = {&data, 1, gen.getData().data(), kill.getData().data(),
+            nullptr, words(output), output.getData().size()};
+        return runKernel<UNION, false, true>(w) || resized;
+    }
+
+    bool meetGenKill (MeetOp op, ArrayRef<const VSet*> inputs, const VSet &gen,
+        const VSet &kill, VSet &input, VSet &output) {
+        size_t size = inputs.empty() ? input.size() : inputs[0]->size();
+        if (inputs.empty() || !sameSize(inputs, size)
+            || gen.size() != size || kill.size() != size) {
+            meetSets(op, inputs, input);
+            return genKill(input, gen, kill, output);
+        }
+
+        bool resized = output.size() != size;
+        input.resize(size);
+        output.resize(size);
+        if (size == 0) {
+            return resized;
+        }
+
+        SmallVector<const Word*, 8> data;
+        for (auto set : inputs) {
+            data.push_back(set->getData().data());
+        }
+        Words w = {data.data(), (unsigned) data.size(), gen.getData().data(),
+            kill.getData().data(), words(input), words(output), input.getData().size()};
+        bool changed = op == UNION ? runKernel<UNION, true, true>(w)
+            : runKernel<INTERSECT, true, true>(w);
+        return changed || resized;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef DATAFLOW_BITKERNELS_H
+#define DATAFLOW_BITKERNELS_H
+
+#include "Dataflow.h"
+
+namespace llvm {
+	// word-level kernels over the bit sets of the solver. Every kernel is
+	// compiled for each instruction set below, the best one the host supports
+	// is picked on first use unless -dataflow-kernels forces one
+	enum KernelIsa {
+		SCALAR,
+		SSE2,
+		AVX2
+	};
+
+	// the instruction set the kernels run with
+	KernelIsa kernelIsa ();
+	bool kernelSupported (KernelIsa isa);
+	// force an instruction set, false if the host does not support it
+	bool setKernelIsa (KernelIsa isa);
+	const char *kernelName (KernelIsa isa);
+
+	// the meet of inputs into `into`, which may be one of them. Every input
+	// has the same size, `into` is resized to it
+	void meetSets (MeetOp op, ArrayRef<const VSet*> inputs, VSet &into);
+
+	// output = (input - kill) U gen in place, true if output changed
+	bool genKill (const VSet &input, const VSet &gen, const VSet &kill, VSet &output);
+
+	// both in one pass over the words: input = meet of inputs, then
+	// output = (input - kill) U gen, true if output changed
+	bool meetGenKill (MeetOp op, ArrayRef<const VSet*> inputs, const VSet &gen,
+		const VSet &kill, VSet &input, VSet &output);
+};
+
+#endif
@@ -0,0 +1,388 @@
+#include "Cache.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#define DEBUG_TYPE "dataflow"
+
+namespace llvm {
+    static cl::opt<std::string> CacheDir("dataflow-cache",
+        cl::desc("Keep analysis results in this directory and reuse them for unchanged functions"),
+        cl::value_desc("dir"), cl::init(""));
+
+    static cl::opt<unsigned> CacheSize("dataflow-cache-size",
+        cl::desc("Megabytes the -dataflow-cache directory is pruned to"),
+        cl::init(512));
+
+    static TrackingStatistic NumCacheHits = {DEBUG_TYPE, "NumCacheHits",
+        "Results read from the dataflow cache"};
+    static TrackingStatistic NumCacheMisses = {DEBUG_TYPE, "NumCacheMisses",
+        "Results solved and written to the dataflow cache"};
+
+    namespace {
+        using namespace support;
+
+        // entry layout, all little endian: the header, then in 32-bit words
+        // the stored domain values and the in and out set of every block as
+        // bit masks. Bump the magic when it changes, old entries then miss
+        const char Magic[4] = {'D', 'F', 'C', '2'};
+        struct Header {
+            char magic[4];
+            ulittle32_t blocks, domain, values, transfers;
+            // what the solve that wrote the entry used
+            ulittle64_t bytes;
+        };
+
+        size_t maskWords (size_t bits) {
+            return (bits + 31) / 32;
+        }
+
+        // everything the analyses look at, in a fixed order. Values are
+        // named by position (arguments, instructions and blocks) or, for
+        // constants and globals, by what they are
+        class FunctionHasher {
+            public:
+            FunctionHasher (DenseMap<const Value*, unsigned> &numbers) : numbers(numbers) {}
+
+            void add (uint64_t word) {
+                uint8_t bytes[8];
+                endian::write64le(bytes, word);
+                buffer.append(bytes, bytes + 8);
+                if (buffer.size() >= 4096) {
+                    flush();
+                }
+            }
+
+            void add (StringRef str) {
+                add(str.size());
+                buffer.append(str.begin(), str.end());
+            }
+
+            void add (Type *type) {
+                add(type->getTypeID());
+                if (auto integer = dyn_cast<IntegerType>(type)) {
+                    add(integer->getBitWidth());
+                } else if (auto pointer = dyn_cast<PointerType>(type)) {
+                    add(pointer->getAddressSpace());
+                } else if (auto array = dyn_cast<ArrayType>(type)) {
+                    add(array->getNumElements());
+                } else if (auto vector = dyn_cast<FixedVectorType>(type)) {
+                    add(vector->getNumElements());
+                }
+
+                // named structs can refer to themselves, their name is enough
+                auto structure = dyn_cast<StructType>(type);
+                if (structure && structure->hasName()) {
+                    add(structure->getName());
+                    return;
+                }
+                if (!isa<PointerType>(type)) {
+                    add(type->getNumContainedTypes());
+                    for (Type *contained : type->subtypes()) {
+                        add(contained);
+                    }
+                }
+            }
+
+            // tagged by kind, so no two operand lists hash the same words
+            void add (const Value *val) {
+                auto it = numbers.find(val);
+                if (it != numbers.end()) {
+                    add(NUMBERED);
+                    add(it->second);
+                    return;
+                }
+
+                add(DESCRIBED);
+                add(val->getValueID());
+                add(val->getType());
+                if (auto global = dyn_cast<GlobalValue>(val)) {
+                    add(global->getName());
+                } else if (auto integer = dyn_cast<ConstantInt>(val)) {
+                    const APInt &value = integer->getValue();
+                    for (unsigned i = 0; i < value.getNumWords(); ++i) {
+                        add(value.getRawData()[i]);
+                    }
+                } else if (auto fp = dyn_cast<ConstantFP>(val)) {
+                    APInt bits = fp->getValueAPF().bitcastToAPInt();
+                    for (unsigned i = 0; i < bits.getNumWords(); ++i) {
+                        add(bits.getRawData()[i]);
+                    }
+                } else if (!isa<ConstantPointerNull>(val) && !isa<UndefValue>(val)
+                    && !isa<ConstantAggregateZero>(val)) {
+                    // constant expressions, aggregates, inline asm and
+                    // metadata are rare enough to be printed
+                    std::string text;
+                    raw_string_ostream OS(text);
+                    val->print(OS);
+                    add(OS.str());
+                }
+            }
+
+            std::string digest (StringRef analysis) {
+                add(analysis);
+                flush();
+                MD5::MD5Result result;
+                hash.final(result);
+                return result.digest().str().str();
+            }
+
+            private:
+            enum OperandKind { NUMBERED, DESCRIBED };
+
+            void flush () {
+                hash.update(ArrayRef<uint8_t>(buffer.data(), buffer.size()));
+                buffer.clear();
+            }
+
+            DenseMap<const Value*, unsigned> &numbers;
+            SmallVector<uint8_t, 4096 + 64> buffer;
+            MD5 hash;
+        };
+
+        // written by this process since the directory was last pruned
+        std::atomic<uint64_t> written(0);
+        std::mutex pruning;
+
+        void prune (bool force) {
+            std::lock_guard<std::mutex> lock(pruning);
+            CachePruningPolicy policy;
+            // a process only scans the directory once a minute on its own,
+            // but right away once it wrote an eighth of the cap
+            policy.Interval = std::chrono::seconds(force ? 0 : 60);
+            policy.MaxSizeBytes = (uint64_t) CacheSize << 20;
+            pruneCache(CacheDir, policy);
+            written = 0;
+        }
+
+        bool openCache () {
+            static bool opened = []() {
+                if (std::error_code EC = sys::fs::create_directories(CacheDir)) {
+                    errs() << "dataflow: can not use cache " << CacheDir << ": " << EC.message() << "\n";
+                    return false;
+                }
+                prune(false);
+                return true;
+            }();
+            return opened;
+        }
+    }
+
+    CachedResult::CachedResult (Function &F, StringRef analysis) : F(F), analysis(analysis) {
+        if (CacheDir.empty() || !openCache()) {
+            return;
+        }
+
+        for (auto &arg : F.args()) {
+            numbers[&arg] = numbered.size();
+            numbered.push_back(&arg);
+        }
+        for (auto &BB : F) {
+            for (auto &I : BB) {
+                numbers[&I] = numbered.size();
+                numbered.push_back(&I);
+            }
+        }
+        // blocks are only referred to, never stored
+        unsigned block = numbered.size();
+        for (auto &BB : F) {
+            numbers[&BB] = block++;
+        }
+
+        FunctionHasher hasher(numbers);
+        hasher.add(F.getFunctionType());
+        for (auto &BB : F) {
+            hasher.add(BB.size());
+            for (auto &I : BB) {
+                hasher.add(I.getOpcode());
+                hasher.add(I.getType());
+                hasher.add(I.getNumOperands());
+                for (auto &op : I.operands()) {
+                    hasher.add(op.get());
+                }
+                if (auto phi = dyn_cast<PHINode>(&I)) {
+                    for (auto incoming : phi->blocks()) {
+                        hasher.add(incoming);
+                    }
+                } else if (auto cmp = dyn_cast<CmpInst>(&I)) {
+                    hasher.add(cmp->getPredicate());
+                }
+            }
+        }
+
+        SmallString<128> entry(CacheDir);
+        sys::path::append(entry, "llvmcache-" + analysis + "-" + hasher.digest(analysis));
+        path = entry.str().str();
+    }
+
+    bool CachedResult::load (DataFlowResult &result, Domain &values) {
+        return read(result, 0, &values);
+    }
+
+    bool CachedResult::load (DataFlowResult &result, size_t domainSize) {
+        return read(result, domainSize, nullptr);
+    }
+
+    bool CachedResult::read (DataFlowResult &result, size_t domainSize, Domain *values) {
+        if (!enabled()) {
+            return false;
+        }
+        PhaseTimer timer(analysis, "cache", F);
+
+        Expected<sys::fs::file_t> file = sys::fs::openNativeFileForRead(path);
+        if (!file) {
+            consumeError(file.takeError());
+            NumCacheMisses++;
+            return false;
+        }
+        auto buffer = MemoryBuffer::getOpenFile(*file, path, -1, false);
+        // pruning drops the least recently used entries first
+        sys::fs::setLastAccessAndModificationTime(*file, std::chrono::system_clock::now());
+        sys::fs::closeFile(*file);
+        if (!buffer) {
+            NumCacheMisses++;
+            return false;
+        }
+
+        StringRef data = (*buffer)->getBuffer();
+        if (data.size() < sizeof(Header)) {
+            NumCacheMisses++;
+            return false;
+        }
+        const Header *header = reinterpret_cast<const Header *>(data.data());
+        size_t domain = header->domain, stored = header->values;
+        size_t words = maskWords(domain);
+        size_t expected = sizeof(Header) + 4 * (stored + 2 * words * header->blocks);
+        if (memcmp(header->magic, Magic, 4) != 0 || header->blocks != F.size()
+            || data.size() != expected || (values ? stored != domain : domain != domainSize)) {
+            NumCacheMisses++;
+            return false;
+        }
+
+        const ulittle32_t *next = reinterpret_cast<const ulittle32_t *>(header + 1);
+        if (values) {
+            for (size_t i = 0; i < stored; ++i) {
+                unsigned number = next[i];
+                if (number >= numbered.size()) {
+                    NumCacheMisses++;
+                    return false;
+                }
+                values->insert(numbered[number]);
+            }
+            next += stored;
+        }
+
+        // masks are read in place on little endian hosts
+        SmallVector<uint32_t, 64> swapped;
+        auto mask = [&](VSet &set) {
+            set.resize(domain);
+            const uint32_t *raw = reinterpret_cast<const uint32_t *>(next);
+            if (!sys::IsLittleEndianHost) {
+                swapped.assign(next, next + words);
+                raw = swapped.data();
+            }
+            set.setBitsInMask(raw, words);
+            next += words;
+        };
+
+        result.numberBlocks(F);
+        for (unsigned b = 0; b < result.size(); ++b) {
+            mask(result[b].in);
+            mask(result[b].out);
+        }
+        result.transferCount = header->transfers;
+        result.bytesUsed = header->bytes;
+        if (reportMemory()) {
+            errs() << "dataflow: " << F.getName() << ": " << result.bytesUsed
+                << " bytes, read from the cache\n";
+        }
+        NumCacheHits++;
+        return true;
+    }
+
+    void CachedResult::store (const DataFlowResult &result, size_t domainSize, const Domain *values) {
+        if (!enabled()) {
+            return;
+        }
+        PhaseTimer timer(analysis, "cache", F);
+
+        size_t stored = values ? values->size() : 0;
+        size_t words = maskWords(domainSize);
+        std::string bytes;
+        bytes.reserve(sizeof(Header) + 4 * (stored + 2 * words * result.size()));
+        raw_string_ostream OS(bytes);
+
+        Header header;
+        memcpy(header.magic, Magic, 4);
+        header.blocks = result.size();
+        header.domain = domainSize;
+        header.values = stored;
+        header.transfers = result.transferCount;
+        header.bytes = result.bytesUsed;
+        OS.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        auto word = [&](uint32_t w) {
+            char buf[4];
+            endian::write32le(buf, w);
+            OS.write(buf, 4);
+        };
+        for (size_t i = 0; i < stored; ++i) {
+            word(numbers.lookup(values->get<Value>(i)));
+        }
+
+        // the words of a set split into 32-bit masks, low half first
+        auto mask = [&](const VSet &set) {
+            size_t emitted = 0;
+            for (auto w : set.getData()) {
+                for (unsigned shift = 0; shift < 8 * sizeof(w) && emitted < words; shift += 32) {
+                    word((uint32_t) (w >> shift));
+                    emitted++;
+                }
+            }
+            for (; emitted < words; ++emitted) {
+                word(0);
+            }
+        };
+        for (unsigned b = 0; b < result.size(); ++b) {
+            mask(result[b].in);
+            mask(result[b].out);
+        }
+        OS.flush();
+
+        SmallString<128> model(sys::path::parent_path(path));
+        sys::path::append(model, "llvmcache-tmp-%%%%%%%%");
+        Expected<sys::fs::TempFile> temp = sys::fs::TempFile::create(model);
+        if (!temp) {
+            consumeError(temp.takeError());
+            return;
+        }
+        {
+            raw_fd_ostream file(temp->FD, false);
+            file << bytes;
+        }
+        // another process may have written the same entry meanwhile, both
+        // are the same so either one is fine
+        if (Error E = temp->keep(path)) {
+            consumeError(std::move(E));
+            consumeError(temp->discard());
+            return;
+        }
+
+        uint64_t cap = (uint64_t) CacheSize << 20;
+        if ((written += bytes.size()) > cap / 8) {
+            prune(true);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef DATAFLOW_CACHE_H
+#define DATAFLOW_CACHE_H
+
+#include "Dataflow.h"
+
+namespace llvm {
+	// the result of one analysis over one function, kept on disk between
+	// runs under -dataflow-cache. Entries are keyed by a hash of everything
+	// the analyses look at, blocks, opcodes, types and which value every
+	// operand is, so a function read back from unchanged IR hits even
+	// though its pointers differ. Names are not part of the key, a renamed
+	// value still hits and prints with its new name.
+	//
+	// Entries are written to a temporary file and renamed into place, so
+	// processes sharing a cache directory only ever see whole entries. The
+	// directory is pruned to -dataflow-cache-size, least recently used first
+	class CachedResult {
+		public:
+		// key F for analysis, does nothing unless -dataflow-cache is set
+		CachedResult (Function &F, StringRef analysis);
+
+		bool enabled () const { return !path.empty(); }
+
+		// the result stored under this key, domain entries are read back as
+		// the values they stood for
+		bool load (DataFlowResult &result, Domain &values);
+		// same for a domain the caller rebuilt itself, only its size is checked
+		bool load (DataFlowResult &result, size_t domainSize);
+
+		// write result, with values its domain if it holds values of F
+		void store (const DataFlowResult &result, size_t domainSize, const Domain *values = nullptr);
+
+		private:
+		bool read (DataFlowResult &result, size_t domainSize, Domain *values);
+
+		Function &F;
+		StringRef analysis;
+		std::string path;
+		// arguments, then instructions in function order, a domain entry is
+		// stored as its position here
+		std::vector<Value*> numbered;
+		DenseMap<const Value*, unsigned> numbers;
+	};
+};
+
+#endif
@@ -0,0 +1,285 @@
+#include "Emitter.h"
+
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+
+#include <mutex>
+
+using namespace llvm;
+namespace {
+    // folding creates constants in the LLVMContext, which the functions the
+    // module driver solves in parallel share
+    std::mutex folding;
+
+    // integer and floating point values are the ones constant folding can
+    // say something about
+    bool tracked (const Value *val) {
+        Type *type = val->getType();
+        return (isa<Argument>(val) || isa<Instruction>(val))
+            && (type->isIntegerTy() || type->isFloatingPointTy());
+    }
+
+    // sparse constant propagation: every tracked value has one cell,
+    // indexed by its domain index, and an instruction is only evaluated
+    // again when one of its operands changed. Blocks are visited once, when
+    // the first edge into them turns out to run; a branch on a constant
+    // only follows the edge it takes, and PHIs only join the incoming values
+    // of edges that run
+    class ConstantPropagation {
+        public:
+        ConstantPropagation (const Domain &domain, const DataLayout &DL)
+        : domain(domain), DL(DL), values(domain.size()), constants(domain.size()) {}
+
+        void solve (Function &F) {
+            // arguments can be anything
+            for (auto &arg : F.args()) {
+                Index i = domain.find(&arg);
+                if (i != Domain::NOT_FOUND) {
+                    values[i] = ConstantValue::overdefined();
+                }
+            }
+
+            reach(&F.getEntryBlock());
+            while (!blockWork.empty() || !valueWork.empty()) {
+                while (!valueWork.empty()) {
+                    Instruction *inst = valueWork.pop_back_val();
+                    if (executable.count(inst->getParent())) {
+                        visit(*inst);
+                    }
+                }
+                while (!blockWork.empty()) {
+                    for (auto &inst : *blockWork.pop_back_val()) {
+                        visit(inst);
+                    }
+                }
+            }
+        }
+
+        ConstantInfo take (Domain domain) {
+            return ConstantInfo(std::move(domain), std::move(values), std::move(constants),
+                std::move(executable));
+        }
+
+        private:
+        void reach (BasicBlock *BB) {
+            if (executable.insert(BB).second) {
+                blockWork.push_back(BB);
+            }
+        }
+
+        // a new edge into a block already visited only changes its PHIs
+        void follow (BasicBlock *from, BasicBlock *to) {
+            if (!edges.insert({from, to}).second) {
+                return;
+            }
+            if (executable.count(to)) {
+                for (auto &phi : to->phis()) {
+                    visit(phi);
+                }
+            }
+            reach(to);
+        }
+
+        void visit (Instruction &inst) {
+            if (inst.isTerminator()) {
+                branch(inst);
+            }
+            Index i = domain.find(&inst);
+            if (i == Domain::NOT_FOUND || values[i].isOverdefined()) {
+                return;
+            }
+
+            Constant *folded = nullptr;
+            ConstantValue value = isa<PHINode>(inst) ? join(cast<PHINode>(inst), folded)
+                : evaluate(inst, i, folded);
+            if (value == values[i]) {
+                return;
+            }
+            values[i] = value;
+            constants[i] = value.isConstant() ? folded : nullptr;
+            for (auto user : inst.users()) {
+                valueWork.push_back(cast<Instruction>(user));
+            }
+        }
+
+        // the successors a terminator can go to, only the taken one when its
+        // condition is a known constant and none while it is undefined
+        void branch (Instruction &term) {
+            BasicBlock *BB = term.getParent();
+            Value *condition = nullptr;
+            if (auto br = dyn_cast<BranchInst>(&term)) {
+                condition = br->isConditional() ? br->getCondition() : nullptr;
+            } else if (auto sw = dyn_cast<SwitchInst>(&term)) {
+                condition = sw->getCondition();
+            }
+
+            if (condition) {
+                Constant *constant;
+                ConstantValue value = operand(condition, constant);
+                if (value.isUndefined()) {
+                    return;
+                }
+                if (auto known = dyn_cast_or_null<ConstantInt>(value.isConstant() ? constant : nullptr)) {
+                    if (auto br = dyn_cast<BranchInst>(&term)) {
+                        follow(BB, br->getSuccessor(known->isZero() ? 1 : 0));
+                    } else {
+                        follow(BB, cast<SwitchInst>(term).findCaseValue(known)->getCaseSuccessor());
+                    }
+                    return;
+                }
+            }
+            for (auto succ : successors(BB)) {
+                follow(BB, succ);
+            }
+        }
+
+        // what an operand is, and its constant if it is one
+        ConstantValue operand (Value *val, Constant *&constant) {
+            if ((constant = dyn_cast<Constant>(val))) {
+                return ConstantValue::constant();
+            }
+            Index i = domain.find(val);
+            if (i == Domain::NOT_FOUND) {
+                return ConstantValue::overdefined();
+            }
+            constant = constants[i];
+            return values[i];
+        }
+
+        // the one constant the incoming values of edges that run agree on,
+        // undefined ones are left out
+        ConstantValue join (PHINode &phi, Constant *&folded) {
+            for (unsigned k = 0; k < phi.getNumIncomingValues(); ++k) {
+                if (!edges.count({phi.getIncomingBlock(k), phi.getParent()})) {
+                    continue;
+                }
+                Constant *constant;
+                ConstantValue value = operand(phi.getIncomingValue(k), constant);
+                if (value.isOverdefined() || (value.isConstant() && folded && folded != constant)) {
+                    return ConstantValue::overdefined();
+                }
+                if (value.isConstant()) {
+                    folded = constant;
+                }
+            }
+            return folded ? ConstantValue::constant() : ConstantValue::bottom();
+        }
+
+        // values only go up, so each one is folded once, when its last
+        // operand becomes a constant
+        ConstantValue evaluate (Instruction &inst, Index i, Constant *&folded) {
+            SmallVector<Constant*, 8> operands;
+            bool undefined = false;
+            for (auto &op : inst.operands()) {
+                Constant *constant;
+                ConstantValue value = operand(op, constant);
+                if (value.isOverdefined()) {
+                    return value;
+                }
+                undefined |= value.isUndefined();
+                operands.push_back(constant);
+            }
+            // wait until every operand is known
+            if (undefined || values[i].isConstant()) {
+                folded = constants[i];
+                return values[i];
+            }
+
+            std::lock_guard<std::mutex> lock(folding);
+            if (auto cmp = dyn_cast<CmpInst>(&inst)) {
+                folded = ConstantFoldCompareInstOperands(cmp->getPredicate(), operands[0], operands[1], DL);
+            } else {
+                folded = ConstantFoldInstOperands(&inst, operands, DL);
+            }
+            return folded ? ConstantValue::constant() : ConstantValue::overdefined();
+        }
+
+        const Domain &domain;
+        const DataLayout &DL;
+        ConstantLattice values;
+        std::vector<Constant*> constants;
+        DenseSet<const BasicBlock*> executable;
+        DenseSet<std::pair<const BasicBlock*, const BasicBlock*>> edges;
+        // blocks reached but not visited yet, and instructions whose operands changed
+        SmallVector<BasicBlock*, 16> blockWork;
+        SmallVector<Instruction*, 64> valueWork;
+    };
+
+    class Constants : public FunctionPass {
+        public:
+        static char ID;
+
+        virtual void getAnalysisUsage (AnalysisUsage& AU) const {
+            AU.setPreservesAll();
+        }
+
+        Constants() : FunctionPass(ID) {}
+
+        virtual bool doInitialization (Module &M) {
+            canEmitConstants("-constants");
+            namer.reset(new ValueNamer(&M));
+            return false;
+        }
+
+        virtual bool runOnFunction (Function &F) {
+            printConstants(F, resultStream(), *namer);
+            return false;
+        }
+
+        private:
+        std::unique_ptr<ValueNamer> namer;
+    };
+
+    char Constants::ID = 0;
+    RegisterPass<Constants> X("constants", "Constant Propagation");
+}
+
+namespace llvm {
+    AnalysisKey ConstantAnalysis::Key;
+
+    ConstantInfo computeConstants (Function &F) {
+        Domain domain;
+        PhaseTimer domainTimer("constants", "domain", F);
+        for (auto &arg : F.args()) {
+            if (tracked(&arg)) {
+                domain.insert(&arg);
+            }
+        }
+        for (auto &I : instructions(F)) {
+            if (tracked(&I)) {
+                domain.insert(&I);
+            }
+        }
+        domainTimer.stop();
+
+        PhaseTimer solveTimer("constants", "solve", F);
+        ConstantPropagation propagation(domain, F.getParent()->getDataLayout());
+        propagation.solve(F);
+        solveTimer.stop();
+        return propagation.take(std::move(domain));
+    }
+
+    void printConstants (Function &F, raw_ostream &OS, ValueNamer &namer) {
+        computeConstants(F).print(F, OS, namer);
+    }
+
+    ConstantValue ConstantInfo::valueOf (const Value *V) const {
+        Index i = domain.find(V);
+        if (i == Domain::NOT_FOUND) {
+            return ConstantValue::bottom();
+        }
+        return values[i];
+    }
+
+    Constant *ConstantInfo::getConstant (const Value *V) const {
+        if (auto constant = dyn_cast<Constant>(V)) {
+            return const_cast<Constant *>(constant);
+        }
+        return valueOf(V).isConstant() ? constants[domain.find(V)] : nullptr;
+    }
+
+    void ConstantInfo::print (Function &F, raw_ostream &OS, ValueNamer &namer) const {
+        ResultEmitter(OS, namer).emit(F, *this);
+    }
+}
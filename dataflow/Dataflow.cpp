@@ -1,19 +1,71 @@
 #include "llvm/Support/raw_ostream.h"
-#include "Dataflow.h"
+#include "Solver.h"
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+
+#include <algorithm>
+#include <mutex>
 #include <queue>
 
+#define DEBUG_TYPE "dataflow"
+
 namespace llvm {
-    Index Dataflow::domainIndex (void* ptr) {
-        Domain &D = this->domain;
-        auto it = std::find(D.begin(), D.end(), ptr);
-        Index i = std::distance(D.begin(), it);
-        if (i >= this->domain.size() || i < 0) {
-            i = INDEX_NOT_FOUND;
+    static cl::opt<bool> ReportSavings("dataflow-report-savings",
+        cl::desc("Report the transfer evaluations the worklist solver saved over round-robin"),
+        cl::init(false));
+
+    static cl::opt<bool> ReportMemory("dataflow-report-memory",
+        cl::desc("Report the bytes every dataflow run used"),
+        cl::init(false));
+
+    static cl::opt<unsigned> WidenAfter("dataflow-widen-after",
+        cl::desc("Visits of a block before lattice analyses widen what still grows at its input"),
+        cl::init(3));
+
+    static cl::opt<bool> ReportStats("dataflow-stats",
+        cl::desc("Report rounds, transfers, meets, set sizes and phase times of every solve"),
+        cl::init(false));
+
+    static cl::opt<std::string> StatsJson("dataflow-stats-json",
+        cl::desc("Append the same as one JSON object per solve and phase to this file"),
+        cl::value_desc("file"), cl::init(""));
+
+    // tracking even in builds where STATISTIC is a no-op, they are only
+    // touched once per solve with instrumentation on
+    static TrackingStatistic NumSolves = {DEBUG_TYPE, "NumSolves", "Dataflow solves"};
+    static TrackingStatistic NumRounds = {DEBUG_TYPE, "NumRounds", "Fixed-point rounds"};
+    static TrackingStatistic NumTransfers = {DEBUG_TYPE, "NumTransfers",
+        "Transfer function evaluations"};
+    static TrackingStatistic NumMeets = {DEBUG_TYPE, "NumMeets", "Meet operations"};
+    static TrackingStatistic NumSetBits = {DEBUG_TYPE, "NumSetBits",
+        "Facts in the in and out sets at the fixed points"};
+    static TrackingStatistic MaxSetBits = {DEBUG_TYPE, "MaxSetBits",
+        "Most facts in one in or out set"};
+
+    Index Domain::insert (const Value *val) {
+        auto it = indices.find(val);
+        if (it != indices.end()) {
+            return it->second;
         }
+
+        Index i = elements.size();
+        elements.push_back(val);
+        indices.insert(std::make_pair(val, i));
         return i;
     }
 
+    Index Domain::find (const Value *val) const {
+        auto it = indices.find(val);
+        if (it == indices.end()) {
+            return NOT_FOUND;
+        }
+        return it->second;
+    }
+
     void error (std::string err) {
         errs() << "\n[!] " << err << "\n";
         exit(-1);
@@ -35,10 +87,74 @@ namespace llvm {
             && exp.v2 == this->v2);
     }
 
+    Index ExpressionTable::insert (Instruction *ins) {
+        auto known = instructions.find(ins);
+        if (known != instructions.end()) {
+            return known->second;
+        }
+
+        auto bin_op = dyn_cast<BinaryOperator> (ins);
+        if (!bin_op) {
+            error ("BinaryOperator Instruction Only");
+        }
+
+        // commutative operands are hashed in pointer order
+        const Value *left = bin_op->getOperand(0), *right = bin_op->getOperand(1);
+        if (bin_op->isCommutative() && right < left) {
+            std::swap(left, right);
+        }
+        Key key = std::make_pair((unsigned) bin_op->getOpcode(), std::make_pair(left, right));
+
+        auto it = interned.find(key);
+        if (it != interned.end()) {
+            instructions.insert(std::make_pair(ins, it->second));
+            return it->second;
+        }
+
+        Expression *exp = new (arena.Allocate<Expression>()) Expression(ins);
+        Index i = expressions.insert(ins);
+        entries.push_back(exp);
+        interned.insert(std::make_pair(key, i));
+        instructions.insert(std::make_pair(ins, i));
+
+        for (const Value *val : {left, right}) {
+            VSet &users = operandUsers[val];
+            if (users.size() <= (unsigned) i) {
+                users.resize(i + 1);
+            }
+            users.set(i);
+        }
+        return i;
+    }
+
+    Index ExpressionTable::find (const Instruction *ins) const {
+        auto it = instructions.find(ins);
+        if (it == instructions.end()) {
+            return Domain::NOT_FOUND;
+        }
+        return it->second;
+    }
+
+    const VSet *ExpressionTable::users (const Value *val) const {
+        auto it = operandUsers.find(val);
+        return it == operandUsers.end() ? nullptr : &it->second;
+    }
+
+    size_t ExpressionTable::bytesUsed () const {
+        size_t bytes = arena.getBytesAllocated() + expressions.bytesUsed()
+            + entries.capacity() * sizeof(Expression*)
+            + capacity_in_bytes(interned) + capacity_in_bytes(instructions)
+            + capacity_in_bytes(operandUsers);
+        for (auto &users : operandUsers) {
+            bytes += capacity_in_bytes(users.second);
+        }
+        return bytes;
+    }
+
     // code from https://github.com/jarulraj/llvm/ , the find name is too trivial...
-    std::string Expression::toString () {
-        std::string op = "?";
-        switch (this->op) {
+    static const char *opString (Instruction::BinaryOps opcode) {
+        const char *op = "?";
+        switch (opcode) {
         case Instruction::Add:
         case Instruction::FAdd:
             op = "+";
@@ -81,242 +197,367 @@ namespace llvm {
             op = "op";
             break;
         }
-        return getValueName(v1) + " " + op + " " + getValueName(v2);
+        return op;
+    }
+
+    std::string Expression::toString () {
+        return getValueName(v1) + " " + opString(op) + " " + getValueName(v2);
+    }
+
+    std::string Expression::toString (ValueNamer &namer) {
+        return namer.name(v1) + " " + opString(op) + " " + namer.name(v2);
     }
 
     // gmerate meet opeartion for in/out
-    VSet Dataflow::applyMeet (VList input) {
-        VSet result;
+    void Dataflow::applyMeet (VSet &into, const VSet &input) const {
+        if (meetop == MeetOp::UNION) {
+            UnionMeet::meet(into, input);
+        } else {
+            IntersectMeet::meet(into, input);
+        }
+    }
+
+    // empty summary, the transfer is the identity
+    BlockSummary Dataflow::summarize (BasicBlock *) {
+        BlockSummary summary;
+        summary.gen = summary.kill = emptySet();
+        return summary;
+    }
 
-        if (input.empty()) {
-            return result;
+    bool Dataflow::transferFn (const VSet &input, BasicBlock *currentBlock,
+        VSet &output, std::map<BasicBlock*, VSet> &neighbor) {
+        auto summary = summaries.find(currentBlock);
+        if (summary == summaries.end()) {
+            summary = summaries.insert(std::make_pair(currentBlock, summarize(currentBlock))).first;
         }
 
-        for (auto o : input) {
-            // UNION: simply insert all number to set
-            if (meetop == MeetOp::UNION) {
-                result.insert(o.begin(), o.end());
+        return genKillTransfer(summary->second, input, output, neighbor);
+    }
 
-            // INTERSECTION: remove value occurs more than once, otherwise insert it
-            } else if (meetop == MeetOp::INTERSECT) {
-                if (result.empty()) {
-                    result.insert(o.begin(), o.end());
-                    continue;
-                }
+    // the solver sees the virtual interface as one more transfer policy
+    class Dataflow::Adapter {
+        public:
+        Adapter (Dataflow &dataflow) : dataflow(dataflow) {}
 
-                VSet tmp;
-                for (auto value : o) {
-                    auto redundant = result.find(value);
-                    if (redundant != result.end()) {
-                        tmp.insert(value);
-                    }
-                }
-                result = tmp;
-            }
+        VSet emptySet () const { return dataflow.emptySet(); }
+        void fit (VSet &value) const { value.resize(dataflow.domain.size()); }
+
+        void invalidate (Function &F, ArrayRef<BasicBlock*> stale) {
+            invalidateSummaries(dataflow.summaries, F, stale);
         }
 
-        return result;         
-    }
+        size_t bytesUsed () const {
+            return summaryBytes(dataflow.summaries);
+        }
+
+        // transferFn may be overridden, so only the meet uses the kernels
+        template<typename Meet> bool meetTransfer (BasicBlock *BB, ArrayRef<const VSet*> inputs,
+            VSet &input, VSet &output, std::map<BasicBlock*, VSet> &neighbor) {
+            meetSets(Meet::op, inputs, input);
+            return dataflow.transferFn(input, BB, output, neighbor);
+        }
+
+        private:
+        Dataflow &dataflow;
+    };
 
     DataFlowResult Dataflow::run (Function &F, VSet boundary, VSet interior) {
-        std::map<BasicBlock*, BlockResult> result;
-        Domain &domain = this->domain;
-        VSet base;
+        // a first run is a re-run where nothing is known, every block is new
+        summaries.clear();
+        return rerun(F, DataFlowResult(), std::set<BasicBlock*>(), boundary, interior);
+    }
 
-        // initialize the first Block we need to iterate accoring to direction
-        BBList initList, traverseList;
-        switch (direction) {
-            case Direction::FORWARD:
-                initList.push_back(&F.front());
-                break;
-            case Direction::BACKWARD:
-                for (auto &BB : F) {
-                    if(isa<ReturnInst> (BB.getTerminator())) {
-                        initList.push_back(&BB);
-                    }
-                }
-                break;
-            default:
-                error("Unknown Direction");
-                break;
-        }
+    DataFlowResult Dataflow::rerun (Function &F, const DataFlowResult &previous,
+        const std::set<BasicBlock*> &changed, VSet boundary, VSet interior) {
+        Adapter adapter(*this);
 
-        // push other blocks into the list
-        std::map<BasicBlock*, BBList> neighbors;
+        // one instantiation per direction and meet operator
         switch (direction) {
             case Direction::FORWARD:
-                for (auto &BB : F) {
-                    for (auto pred_BB = pred_begin(&BB); pred_BB != pred_end(&BB); ++pred_BB) {
-                        neighbors[&BB].push_back(*pred_BB);
-                    }
+                if (meetop == MeetOp::UNION) {
+                    return DataflowSolver<FORWARD, UnionMeet, Adapter>(adapter, solver)
+                        .rerun(F, previous, changed, boundary, interior);
                 }
-                break;
+                return DataflowSolver<FORWARD, IntersectMeet, Adapter>(adapter, solver)
+                    .rerun(F, previous, changed, boundary, interior);
             case Direction::BACKWARD:
-                for (auto &BB : F) {
-                    for (auto succ_BB = succ_begin(&BB); succ_BB != succ_end(&BB); ++succ_BB) {
-                        neighbors[&BB].push_back(*succ_BB);
-                    }
+                if (meetop == MeetOp::UNION) {
+                    return DataflowSolver<BACKWARD, UnionMeet, Adapter>(adapter, solver)
+                        .rerun(F, previous, changed, boundary, interior);
                 }
-                break;
+                return DataflowSolver<BACKWARD, IntersectMeet, Adapter>(adapter, solver)
+                    .rerun(F, previous, changed, boundary, interior);
             default:
                 error("Unknown Direction");
-                break;
+                return DataFlowResult();
         }
+    }
 
-        // initialize boudary set value
-        BlockResult boundaryRes = BlockResult();
-        if (direction == Direction::FORWARD) {
-            boundaryRes.in = boundary;
-            base = boundary;
-        } else {
-            boundaryRes.out = boundary;
+    bool reportSavings () {
+        return ReportSavings;
+    }
+
+    bool reportMemory () {
+        return ReportMemory;
+    }
+
+    unsigned widenAfter () {
+        return WidenAfter;
+    }
+
+    bool instrumenting () {
+        return ReportStats || !StatsJson.empty() || AreStatisticsEnabled();
+    }
+
+    // solves run on many threads under -dataflow-module, one report at a time
+    static std::mutex reportLock;
+
+    static void writeJson (json::Object record) {
+        static std::unique_ptr<raw_fd_ostream> file;
+        if (!file) {
+            std::error_code EC;
+            file.reset(new raw_fd_ostream(StatsJson, EC, sys::fs::OF_Append));
+            if (EC) {
+                error("can not write " + StatsJson + ": " + EC.message());
+            }
         }
+        *file << json::Value(std::move(record)) << "\n";
+        file->flush();
+    }
 
-        for (auto BB : initList) {
-            result.insert(std::pair<BasicBlock*, BlockResult>(BB, boundaryRes));
+    void reportSolve (StringRef analysis, const Function &F, const SolverStats &stats) {
+        NumSolves++;
+        NumRounds += stats.rounds;
+        NumTransfers += stats.transfers;
+        NumMeets += stats.meets;
+        NumSetBits += stats.setBits;
+        MaxSetBits.updateMax(stats.maxSetBits);
+
+        std::lock_guard<std::mutex> guard(reportLock);
+        if (ReportStats) {
+            errs() << "dataflow: " << analysis << " " << F.getName() << ": solve "
+                << format("%.6fs", stats.seconds) << ", " << stats.rounds << " rounds, "
+                << stats.transfers << " transfers, " << stats.meets << " meets, "
+                << stats.setBits << " facts, at most " << stats.maxSetBits << " in a set\n";
         }
+        if (!StatsJson.empty()) {
+            json::Array blocks;
+            for (auto count : stats.blockTransfers) {
+                blocks.push_back((int64_t) count);
+            }
+            writeJson(json::Object{
+                {"analysis", analysis}, {"function", F.getName()}, {"phase", "solve"},
+                {"seconds", stats.seconds}, {"rounds", (int64_t) stats.rounds},
+                {"transfers", (int64_t) stats.transfers}, {"meets", (int64_t) stats.meets},
+                {"set_bits", (int64_t) stats.setBits}, {"max_set_bits", (int64_t) stats.maxSetBits},
+                {"block_transfers", std::move(blocks)}
+            });
+        }
+    }
 
-        // initalize interior set value
-        BlockResult interiorRes = BlockResult();
-        if (direction == Direction::FORWARD) {
-            interiorRes.out = interior;
-        } else {
-            interiorRes.in = interior;
-            base = interior;
+    void reportPhase (StringRef analysis, StringRef phase, const Function &F, double seconds) {
+        std::lock_guard<std::mutex> guard(reportLock);
+        if (ReportStats) {
+            errs() << "dataflow: " << analysis << " " << F.getName() << ": " << phase
+                << " " << format("%.6fs", seconds) << "\n";
+        }
+        if (!StatsJson.empty()) {
+            writeJson(json::Object{
+                {"analysis", analysis}, {"function", F.getName()}, {"phase", phase},
+                {"seconds", seconds}
+            });
         }
+    }
+
+    BlockEdges BlockEdges::reverse () const {
+        BlockEdges reversed(*start.get_allocator().arena);
+        reversed.start.assign(size() + 1, 0);
+        reversed.targets.resize(targets.size());
 
-        for (auto &BB : F) {
-            if (result.find(&BB) == result.end()) {
-                result.insert(std::pair<BasicBlock*, BlockResult>(&BB, interiorRes));
+        // count the edges into every block, then place them
+        for (auto target : targets) {
+            reversed.start[target + 1]++;
+        }
+        for (unsigned i = 0; i < size(); ++i) {
+            reversed.start[i + 1] += reversed.start[i];
+        }
+        ArenaVector<unsigned> next(reversed.start.begin(), reversed.start.end() - 1,
+            start.get_allocator());
+        for (unsigned i = 0; i < size(); ++i) {
+            for (auto target : (*this)[i]) {
+                reversed.targets[next[target]++] = i;
             }
         }
 
-        // Use BFS to determine traverse order
-        std::set<BasicBlock*> visited;
-        while (!initList.empty())
-        {
-            BasicBlock *currBB = initList[0];
-            traverseList.push_back(currBB);
-            initList.erase(initList.begin());
-            visited.insert(currBB);
-
-            switch (direction)
-            {
-            case FORWARD:
-                for (auto succ_BB = succ_begin(currBB); succ_BB != succ_end(currBB); ++succ_BB)
-                {
-                    if (visited.find(*succ_BB) == visited.end())
-                    {
-                        initList.push_back(*succ_BB);
-                    }
-                }
-                break;
-            case BACKWARD:
-                for (auto prev_BB = pred_begin(currBB); prev_BB != pred_end(currBB); ++prev_BB)
-                {
-                    if (visited.find(*prev_BB) == visited.end())
-                    {
-                        initList.push_back(*prev_BB);
-                    }
-                }
-                break;
-            default:
-                error("Unknown Direction");
-                break;
-            }
+        return reversed;
+    }
+
+    namespace {
+        const unsigned UNVISITED = ~0u;
+
+        // Tarjan's state over every block of the function, allocated once per
+        // orderBlocks. Each level clears only the blocks it looked at, so a
+        // nested component costs its own size, not the function's
+        struct ComponentScratch {
+            ComponentScratch (size_t blocks, ArenaAllocator<unsigned> arena)
+            : index(blocks, UNVISITED, arena), lowlink(blocks, 0, arena),
+            member(blocks, false, arena), onStack(blocks, false, arena),
+            stack(arena), dfs(arena) {}
+
+            ArenaVector<unsigned> index, lowlink;
+            ArenaVector<bool> member, onStack;
+            ArenaVector<unsigned> stack;
+            // explicit DFS stack of (block, next edge to follow), big functions
+            // would overflow the call stack
+            ArenaVector<std::pair<unsigned, unsigned>> dfs;
+        };
+    }
+
+    // Tarjan's algorithm restricted to `blocks`. Components come out in reverse
+    // postorder, each one listed in DFS discovery order so the block the DFS
+    // entered it through (the loop head) is first
+    static ArenaVector<ArenaVector<unsigned>> components (ArrayRef<unsigned> blocks,
+        const BlockEdges &edges, ComponentScratch &scratch, ArenaAllocator<unsigned> arena) {
+        auto &index = scratch.index, &lowlink = scratch.lowlink;
+        auto &member = scratch.member, &onStack = scratch.onStack;
+        auto &stack = scratch.stack;
+        auto &dfs = scratch.dfs;
+        ArenaVector<ArenaVector<unsigned>> sccs(arena);
+        unsigned next = 0;
+
+        for (auto BB : blocks) {
+            member[BB] = true;
         }
 
-        // fixed point algorithm, iterate until it does not change
-        bool converged = false;
-        while (!converged) {
-            converged = true;
+        for (auto root : blocks) {
+            if (index[root] != UNVISITED) {
+                continue;
+            }
 
-            for (auto currBB : traverseList) {
-                // we use calculate meet value first
-                VList meetInput;
+            index[root] = lowlink[root] = next++;
+            stack.push_back(root);
+            onStack[root] = true;
+            dfs.push_back(std::make_pair(root, 0));
 
-                // if we have to initialize with some values
-                if (direction == BACKWARD && isa<ReturnInst>(currBB->getTerminator())) {
-                    meetInput.push_back(base);
-                }
+            while (!dfs.empty()) {
+                unsigned BB = dfs.back().first;
+                ArrayRef<unsigned> out = edges[BB];
 
-                if (direction == FORWARD && currBB == &F.front()) {
-                    meetInput.push_back(base);
-                }
-                
-                for (auto n : neighbors[currBB]) {
-                    VSet value;
-                    if (direction == Direction::FORWARD) {
-                        value = result[n].out;
-                    } else {
-                        value = result[n].in;
+                if (dfs.back().second < out.size()) {
+                    unsigned succ = out[dfs.back().second++];
+                    if (!member[succ]) {
+                        continue;
                     }
-                    meetInput.push_back(value);
-                }
-                
-                // then is transfer value
-                VSet meetResult = applyMeet(meetInput);
-                if (direction == Direction::FORWARD) {
-                    result[currBB].in = meetResult;
-                } else {
-                    result[currBB].out = meetResult;
+                    if (index[succ] == UNVISITED) {
+                        index[succ] = lowlink[succ] = next++;
+                        stack.push_back(succ);
+                        onStack[succ] = true;
+                        dfs.push_back(std::make_pair(succ, 0));
+                    } else if (onStack[succ]) {
+                        lowlink[BB] = std::min(lowlink[BB], index[succ]);
+                    }
+                    continue;
                 }
 
-                VSet *blockInput = (direction == Direction::FORWARD) 
-                    ? &result[currBB].in : &result[currBB].out;
-                TransferOutput transferRes = transferFn (*blockInput, currBB);
-                VSet *blockOutput = (direction == Direction::FORWARD) 
-                    ? &result[currBB].out : &result[currBB].in; 
-
-                // check if previous result and the transfer result are the same
-                if (converged) {
-                    if (transferRes.transfer != *blockOutput ||
-                        result[currBB].transferOutput.neighbor.size() != transferRes.neighbor.size()) {
-                        converged = false;
-                    }
+                dfs.pop_back();
+                if (!dfs.empty()) {
+                    unsigned parent = dfs.back().first;
+                    lowlink[parent] = std::min(lowlink[parent], lowlink[BB]);
                 }
 
-                // update value
-                *blockOutput = transferRes.transfer;
-                result[currBB].transferOutput.neighbor = transferRes.neighbor;
+                // BB is the root of a component, pop it off
+                if (lowlink[BB] == index[BB]) {
+                    ArenaVector<unsigned> scc(arena);
+                    unsigned top;
+                    do {
+                        top = stack.back();
+                        stack.pop_back();
+                        onStack[top] = false;
+                        scc.push_back(top);
+                    } while (top != BB);
+
+                    std::sort(scc.begin(), scc.end(), [&index](unsigned a, unsigned b) {
+                        return index[a] < index[b];
+                    });
+                    sccs.push_back(std::move(scc));
+                }
             }
         }
 
-        DataFlowResult analysis;
-        analysis.result = result;
+        // the stacks are empty again, leave the rest as the next level expects it
+        for (auto BB : blocks) {
+            index[BB] = UNVISITED;
+            lowlink[BB] = 0;
+            member[BB] = false;
+        }
 
-        return analysis;
+        // Tarjan finishes components in postorder
+        std::reverse(sccs.begin(), sccs.end());
+        return sccs;
     }
 
-    // code from https://github.com/jarulraj/llvm/ , the find name is too trivial...
-    std::string getValueName (Value *v) {
+    static void orderComponents (ArrayRef<unsigned> blocks, const BlockEdges &edges,
+        ComponentScratch &scratch, ArenaVector<unsigned> &order) {
+        for (auto &scc : components(blocks, edges, scratch, order.get_allocator())) {
+            order.push_back(scc[0]);
+            if (scc.size() > 1) {
+                orderComponents(ArrayRef<unsigned>(scc).drop_front(), edges, scratch, order);
+            }
+        }
+    }
+
+    void orderBlocks (ArrayRef<unsigned> blocks, const BlockEdges &edges,
+        ArenaVector<unsigned> &order) {
+        ComponentScratch scratch(edges.size(), order.get_allocator());
+        orderComponents(blocks, edges, scratch, order);
+    }
+
+    // same naming scheme as https://github.com/jarulraj/llvm/, but slots come
+    // from the tracker instead of printing the instruction and parsing it back
+    std::string ValueNamer::name (const Value *v) {
         // If we can get name directly
-        if (v->getName().str().length() > 0) {
+        if (v->hasName()) {
             return "%" + v->getName().str();
         } else if (isa<Instruction>(v)) {
-            std::string s = "";
-            raw_string_ostream *strm = new raw_string_ostream(s);
-            v->print(*strm);
-            std::string inst = strm->str();
-            size_t idx1 = inst.find("%");
-            size_t idx2 = inst.find(" ", idx1);
-            if (idx1 != std::string::npos && idx2 != std::string::npos && idx1 == 2) {
-                return inst.substr(idx1, idx2 - idx1);
-            } else {
+            int slot = MST.getLocalSlot(v);
+            if (v->getType()->isVoidTy() || slot < 0) {
                 // nothing match
                 return "";
             }
-        } else if (ConstantInt *cint = dyn_cast<ConstantInt>(v)) {
+            return "%" + std::to_string(slot);
+        } else if (const ConstantInt *cint = dyn_cast<ConstantInt>(v)) {
             std::string s = "";
-            raw_string_ostream *strm = new raw_string_ostream(s);
-            cint->getValue().print(*strm, true);
-            return strm->str();
+            raw_string_ostream strm(s);
+            cint->getValue().print(strm, true);
+            return strm.str();
         } else {
             std::string s = "";
-            raw_string_ostream *strm = new raw_string_ostream(s);
-            v->print(*strm);
-            std::string inst = strm->str();
+            raw_string_ostream strm(s);
+            v->print(strm, MST);
+            std::string inst = strm.str();
             return "\"" + inst + "\"";
         }
     }
-};
\ No newline at end of file
+
+    std::string ValueNamer::operand (const Value *v) {
+        std::string s;
+        raw_string_ostream strm(s);
+        v->printAsOperand(strm, true, MST);
+        return strm.str();
+    }
+
+    std::string getValueName (Value *v) {
+        const Function *F = nullptr;
+        if (auto inst = dyn_cast<Instruction>(v)) {
+            F = inst->getFunction();
+        } else if (auto arg = dyn_cast<Argument>(v)) {
+            F = arg->getParent();
+        }
+
+        ValueNamer namer(F ? F->getParent() : nullptr);
+        if (F) {
+            namer.incorporate(*F);
+        }
+        return namer.name(v);
+    }
+};
@@ -1,17 +1,72 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
 #include "llvm/Pass.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/IR/ModuleSlotTracker.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/TimeProfiler.h"
 
+#include <chrono>
+#include <deque>
 #include <vector>
 #include <set>
+#include <map>
 
 namespace llvm {
 	// cutomize errors for quiting
 	void error(std::string);
 
+	// STL allocator handing out memory from a BumpPtrAllocator. Nothing is
+	// given back until the arena is reset or destroyed, so everything built
+	// in one arena is freed in one shot
+	template<typename T> class ArenaAllocator {
+		public:
+		typedef T value_type;
+
+		ArenaAllocator (BumpPtrAllocator &arena) : arena(&arena) {}
+		template<typename U> ArenaAllocator (const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+		T *allocate (size_t n) { return arena->Allocate<T>(n); }
+		void deallocate (T *, size_t) {}
+
+		template<typename U> bool operator== (const ArenaAllocator<U> &other) const {
+			return arena == other.arena;
+		}
+		template<typename U> bool operator!= (const ArenaAllocator<U> &other) const {
+			return arena != other.arena;
+		}
+
+		BumpPtrAllocator *arena;
+	};
+
+	template<typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+	// names values like getValueName and prints instructions, sharing one slot
+	// tracker instead of numbering the module on every call. Not thread safe,
+	// use one per thread
+	class ValueNamer {
+		public:
+		ValueNamer (const Module *M) : MST(M) {}
+
+		// number the local values of F, names are only valid inside it
+		void incorporate (const Function &F) { MST.incorporateFunction(F); }
+		std::string name (const Value *v);
+		// v printed as an operand with its type, "i32 5"
+		std::string operand (const Value *v);
+		void print (raw_ostream &OS, const Instruction &I) { I.print(OS, MST); }
+
+		private:
+		ModuleSlotTracker MST;
+	};
+
 	// Expression for storing BinaryInstruction, easier for comparasion
 	class Expression {
 		public:
@@ -20,40 +75,91 @@ namespace llvm {
 		Expression (Instruction *ins);
 		bool operator== (const Expression &exp);
 		std::string toString();
+		std::string toString(ValueNamer &namer);
 	};
 
 	// ADT for storing BasicBlock and Instructions
+	// sets are dense bit-vectors over the domain, bit i stands for domain[i]
 	typedef int Index;
 	typedef std::vector<BasicBlock*> BBList;
-	typedef std::set<Index> VSet;
+	typedef BitVector VSet;
 	typedef std::vector<VSet> VList;
-	typedef std::vector<void*> Domain;
 
-	// union two set
-	template<typename T> std::set<T> unionSet (std::set<T> s1, std::set<T> s2) {
-		std::set<T> result;
-		result.insert(s1.begin(), s1.end());
-		result.insert(s2.begin(), s2.end());
+	// values an analysis reasons about, numbered densely in insertion order
+	class Domain {
+		public:
+		static const Index NOT_FOUND = -1;
 
-		return result;
-	}
+		// add val unless it is already there, return its index
+		Index insert (const Value *val);
+		// index of val, NOT_FOUND if it is not in the domain
+		Index find (const Value *val) const;
+		bool contains (const Value *val) const { return indices.count(val); }
 
-	// intersection of two sets
-	template<typename T> std::set<T> substractSet (std::set<T> s1, std::set<T> s2) {
-		std::set<T> result;
-		result.insert(s1.begin(), s1.end());
-		for (auto i = s2.begin(); i != s2.end(); ++i) {
-			auto iter = result.find(*i);
-			if (iter != result.end()) {
-				result.erase(iter);
-			}
+		template<typename T> const T *get (Index i) const {
+			return cast<T>(elements[i]);
 		}
 
-		return result;
+		size_t size () const { return elements.size(); }
+		bool empty () const { return elements.empty(); }
+		size_t bytesUsed () const {
+			return elements.capacity() * sizeof(const Value*) + capacity_in_bytes(indices);
+		}
+
+		private:
+		std::vector<const Value*> elements;
+		DenseMap<const Value*, Index> indices;
+	};
+
+	// union s2 into s1, true if s1 changed
+	inline bool unionSet (VSet &s1, const VSet &s2) {
+		bool changed = s2.test(s1);
+		s1 |= s2;
+
+		return changed;
 	}
 
+	// substract s2 from s1, true if s1 changed
+	inline bool substractSet (VSet &s1, const VSet &s2) {
+		bool changed = s1.anyCommon(s2);
+		s1.reset(s2);
+
+		return changed;
+	}
+
+	// interned BinaryOperator expressions. Identical expressions share one
+	// entry (a+b and b+a too), which keeps the operand order it was first seen with
+	class ExpressionTable {
+		public:
+		// index of the expression ins computes, added on first sight
+		Index insert (Instruction *ins);
+		// index of the expression ins computes, NOT_FOUND if it was never inserted
+		Index find (const Instruction *ins) const;
+		// expressions using val as an operand, null if there are none
+		const VSet *users (const Value *val) const;
+
+		Expression *get (Index i) const { return entries[i]; }
+		const Domain &domain () const { return expressions; }
+		size_t size () const { return expressions.size(); }
+		// expressions, lookup tables and user sets
+		size_t bytesUsed () const;
+
+		private:
+		typedef std::pair<unsigned, std::pair<const Value*, const Value*>> Key;
+
+		BumpPtrAllocator arena;
+		// each expression by the first instruction computing it
+		Domain expressions;
+		std::vector<Expression*> entries;
+		DenseMap<Key, Index> interned;
+		DenseMap<const Instruction*, Index> instructions;
+		DenseMap<const Value*, VSet> operandUsers;
+	};
+
 	// convert an expression to index ID
-	Index domainIndex (Domain &D, void* ptr);
+	inline Index domainIndex (const Domain &D, const Value* val) {
+		return D.find(val);
+	}
 
 	// dataflow direction
 	enum Direction {
@@ -67,44 +173,252 @@ namespace llvm {
 		UNION
 	};
 
-	// result for transfer function
-	struct TransferOutput {
-		VSet transfer;
+	// fixed point engines
+	enum Solver {
+		WORKLIST,
+		ROUND_ROBIN
+	};
+
+	// result for transfer function, over the solver's lattice
+	template<typename Lattice> struct TransferOutputOf {
+		Lattice transfer;
+		// facts that only flow along the edge to one neighbor, e.g. PHI operands
+		std::map<BasicBlock*, Lattice> neighbor;
+	};
+	typedef TransferOutputOf<VSet> TransferOutput;
+
+	// gen/kill summary of a block, the transfer is (input - kill) U gen
+	struct BlockSummary {
+		VSet gen, kill;
+		// same as TransferOutput::neighbor, does not depend on the input
 		std::map<BasicBlock*, VSet> neighbor;
 	};
 
+	inline size_t capacity_in_bytes (const BlockSummary &summary) {
+		size_t bytes = capacity_in_bytes(summary.gen) + capacity_in_bytes(summary.kill);
+		for (auto &edge : summary.neighbor) {
+			bytes += capacity_in_bytes(edge.second);
+		}
+		return bytes;
+	}
+
 	// in and out result for blocks
-	struct BlockResult {
-		VSet in, out;
-		TransferOutput transferOutput;
+	template<typename Lattice> struct BlockResultOf {
+		Lattice in, out;
+		TransferOutputOf<Lattice> transferOutput;
+	};
+	typedef BlockResultOf<VSet> BlockResult;
+
+	// the final result. Blocks are numbered densely in function order and
+	// their values kept in one array, so solvers and clients can walk them by
+	// number; looking a block up by pointer is one hash lookup
+	template<typename Lattice> struct DataFlowResultOf {
+		std::vector<BasicBlock*> blocks;
+		std::vector<BlockResultOf<Lattice>> values;
+		DenseMap<const BasicBlock*, unsigned> numbers;
+		// transfer function evaluations it took to converge
+		unsigned transferCount = 0;
+		// memory the run needed: solver tables, block values and whatever
+		// the transfer keeps
+		size_t bytesUsed = 0;
+		// the blocks each block met in the run that built this, by number
+		// and in CSR form like BlockEdges. A rerun compares them with the
+		// edited CFG, empty if the result was not solved (cache hits)
+		std::vector<unsigned> neighborStart, neighborTargets;
+		// the terminator of every block when it was numbered. A block freed
+		// and another allocated at its address has a new terminator, so a
+		// rerun does not take it for the old one
+		std::vector<const Instruction*> terminators;
+
+		// number the blocks of F, each starts with a default value
+		void numberBlocks (Function &F) {
+			blocks.clear();
+			numbers.clear();
+			terminators.clear();
+			neighborStart.clear();
+			neighborTargets.clear();
+			for (auto &BB : F) {
+				numbers[&BB] = blocks.size();
+				blocks.push_back(&BB);
+				terminators.push_back(BB.getTerminator());
+			}
+			values.assign(blocks.size(), BlockResultOf<Lattice>());
+		}
+
+		unsigned size () const { return blocks.size(); }
+		bool contains (const BasicBlock *BB) const { return numbers.count(BB); }
+		// BB is the block numbered here, not a new one at the same address
+		bool sameBlock (const BasicBlock *BB) const {
+			auto it = numbers.find(BB);
+			return it != numbers.end() && terminators[it->second] == BB->getTerminator();
+		}
+		bool hasNeighbors () const { return neighborStart.size() == blocks.size() + 1; }
+		ArrayRef<unsigned> neighbors (unsigned i) const {
+			return ArrayRef<unsigned>(neighborTargets).slice(neighborStart[i],
+				neighborStart[i + 1] - neighborStart[i]);
+		}
+		unsigned number (const BasicBlock *BB) const {
+			auto it = numbers.find(BB);
+			assert(it != numbers.end() && "block is not part of the result");
+			return it->second;
+		}
+
+		// block-indexed view
+		BlockResultOf<Lattice> &operator[] (unsigned i) { return values[i]; }
+		const BlockResultOf<Lattice> &operator[] (unsigned i) const { return values[i]; }
+
+		BlockResultOf<Lattice> &at (const BasicBlock *BB) { return values[number(BB)]; }
+		const BlockResultOf<Lattice> &at (const BasicBlock *BB) const { return values[number(BB)]; }
+	};
+	typedef DataFlowResultOf<VSet> DataFlowResult;
+
+	// edges between densely numbered blocks in CSR form, the targets of block
+	// i are targets[start[i]] up to targets[start[i + 1]]
+	struct BlockEdges {
+		BlockEdges (BumpPtrAllocator &arena)
+		: start(ArenaAllocator<unsigned>(arena)), targets(ArenaAllocator<unsigned>(arena))
+		{
+
+		};
+
+		ArenaVector<unsigned> start, targets;
+
+		unsigned size () const { return start.empty() ? 0 : start.size() - 1; }
+		ArrayRef<unsigned> operator[] (unsigned i) const {
+			return ArrayRef<unsigned>(targets).slice(start[i], start[i + 1] - start[i]);
+		}
+		// the same edges pointing the other way, in the same arena
+		BlockEdges reverse () const;
+	};
+
+	// components in reverse postorder along `edges`, every loop emits its head
+	// and then its body ordered the same way, so nested loops are contiguous
+	// and innermost loops come out as tight ranges. Scratch space comes from
+	// the arena of `order`
+	void orderBlocks (ArrayRef<unsigned> blocks, const BlockEdges &edges,
+		ArenaVector<unsigned> &order);
+
+	// -dataflow-report-savings: also solve round-robin and report the
+	// transfer evaluations the worklist saved
+	bool reportSavings ();
+	// -dataflow-report-memory: report the bytes every run used
+	bool reportMemory ();
+	// -dataflow-widen-after: visits of a block before a lattice transfer
+	// widens its input (Lattice.h)
+	unsigned widenAfter ();
+
+	// what one solve did. Only kept with instrumentation on (-dataflow-stats,
+	// -dataflow-stats-json or -stats), otherwise the solver checks one
+	// null pointer per block visit
+	struct SolverStats {
+		// sweeps over the blocks, for the worklist every time it goes back
+		// to an earlier block
+		unsigned rounds = 0;
+		uint64_t transfers = 0, meets = 0;
+		// transfer evaluations of every block, by block number
+		std::vector<unsigned> blockTransfers;
+		// facts in the in and out sets at the fixed point, for a lattice
+		// the elements above bottom
+		uint64_t setBits = 0;
+		unsigned maxSetBits = 0;
+		double seconds = 0;
 	};
 
-	// the final result
-	struct DataFlowResult {
-		std::map<BasicBlock*, BlockResult> result;
+	bool instrumenting ();
+	// add a finished solve or another phase of an analysis of F to the
+	// statistics and the -dataflow-stats and -dataflow-stats-json reports
+	void reportSolve (StringRef analysis, const Function &F, const SolverStats &stats);
+	void reportPhase (StringRef analysis, StringRef phase, const Function &F, double seconds);
+
+	// one phase of an analysis of F, a "dataflow <phase>" TimeTrace scope
+	// (free unless a profiler runs) and, with instrumentation on, timed and
+	// reported when it stops or goes out of scope
+	class PhaseTimer {
+		public:
+		PhaseTimer (StringRef analysis, StringRef phase, const Function &F)
+		: analysis(analysis), phase(phase), F(F), timed(instrumenting()),
+		trace(timeTraceProfilerEnabled() ? ("dataflow " + phase).str() : std::string(),
+			[&]() { return (analysis + " " + F.getName()).str(); })
+		{
+			if (timed) {
+				start = std::chrono::steady_clock::now();
+			}
+		};
+		~PhaseTimer () { stop(); }
+
+		void stop () {
+			if (timed) {
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				reportPhase(analysis, phase, F, elapsed.count());
+				timed = false;
+			}
+		}
+
+		private:
+		StringRef analysis, phase;
+		const Function &F;
+		bool timed;
+		TimeTraceScope trace;
+		std::chrono::steady_clock::time_point start;
 	};
 
-	// dataflow framework
+	// dataflow framework with the analysis behind virtual functions, for
+	// analyses that are not compiled in. Runs on DataflowSolver (Solver.h),
+	// which in-tree analyses use directly
 	class Dataflow {
 		public:
-		Dataflow (Direction direction, MeetOp meetop, Domain domain)
-		: direction(direction), meetop(meetop), domain(domain)
+		Dataflow (Direction direction, MeetOp meetop, Domain domain, Solver solver = WORKLIST)
+		: direction(direction), meetop(meetop), domain(domain), solver(solver)
 		{
 
 		};
 
-		VSet applyMeet (VList input);
+		// meet input into `into` in place
+		void applyMeet (VSet &into, const VSet &input) const;
+		// empty and universal set sized from the domain
+		VSet emptySet () const { return VSet(domain.size()); }
+		VSet fullSet () const { return VSet(domain.size(), true); }
 		DataFlowResult run (Function &F, VSet boudary, VSet interior);
-		Index domainIndex (void* ptr);
-		virtual TransferOutput transferFn (VSet input, BasicBlock *currentBlock) = 0;
-		const Index INDEX_NOT_FOUND = -1;
+		// re-solve after editing the blocks in `changed` (new blocks count as
+		// changed, and so do blocks that gained or lost a neighbor or whose
+		// terminator was replaced), starting
+		// from the result of the previous run or rerun. Only blocks downstream
+		// of a change are recomputed, the result is the same as a fresh run.
+		// The domain may have grown but not renumbered
+		DataFlowResult rerun (Function &F, const DataFlowResult &previous,
+			const std::set<BasicBlock*> &changed, VSet boudary, VSet interior);
+		Index domainIndex (const Value* val) const { return domain.find(val); }
+		// analyses describe a block by its gen/kill summary, built once per run
+		virtual BlockSummary summarize (BasicBlock *currentBlock);
+		// defaults to (input - kill) U gen over the summary, analyses that are
+		// not gen/kill problems override this instead. Updates the block's
+		// output and edge facts in place, true if either changed
+		virtual bool transferFn (const VSet &input, BasicBlock *currentBlock,
+			VSet &output, std::map<BasicBlock*, VSet> &neighbor);
+		const Index INDEX_NOT_FOUND = Domain::NOT_FOUND;
 		Domain domain;
 
+		void setSolver (Solver s) { solver = s; }
+
 		private:
+		// transfer policy handing the templated solver to the virtual functions
+		class Adapter;
+
 		Direction direction;
 		MeetOp meetop;
+		Solver solver;
+		DenseMap<BasicBlock*, BlockSummary> summaries;
 	};
 
-	// convert LLVM value to corresponding std::string
+	// convert LLVM value to corresponding std::string, numbers the whole
+	// function on every call, use a ValueNamer for more than a few names
 	std::string getValueName (Value* v);
+
+	// run an analysis on F and print its result to OS
+	void printLiveness (Function &F, raw_ostream &OS, ValueNamer &namer);
+	void printReaching (Function &F, raw_ostream &OS, ValueNamer &namer);
+	void printAvailable (Function &F, raw_ostream &OS, ValueNamer &namer);
+	void printConstants (Function &F, raw_ostream &OS, ValueNamer &namer);
 };
+
+#endif
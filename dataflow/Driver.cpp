@@ -0,0 +1,175 @@
+#include "Emitter.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace llvm;
+namespace {
+    enum AnalysisKind {
+        LIVENESS,
+        REACHING,
+        AVAILABLE,
+        CONSTANTS
+    };
+
+    static cl::opt<AnalysisKind> Analysis("dataflow-analysis",
+        cl::desc("Analysis -dataflow-module runs on every function"),
+        cl::values(
+            clEnumValN(LIVENESS, "liveness", "Liveness Analysis"),
+            clEnumValN(REACHING, "reaching", "Reaching Definition"),
+            clEnumValN(AVAILABLE, "available", "Available Expression"),
+            clEnumValN(CONSTANTS, "constants", "Constant Propagation")),
+        cl::init(LIVENESS));
+
+    static cl::opt<unsigned> Threads("dataflow-threads",
+        cl::desc("Worker threads for -dataflow-module, 0 uses every core"),
+        cl::init(0));
+
+    static cl::opt<bool> Summaries("dataflow-summaries",
+        cl::desc("Solve -dataflow-module bottom-up over the call graph, calls use the "
+            "liveness or reaching summaries of their callees, other analyses ignore it"),
+        cl::init(false));
+
+    // analyze every function of the module through a thread pool, functions
+    // are independent so each one is solved and printed by a single worker
+    class ModuleDriver : public ModulePass {
+        public:
+        static char ID;
+
+        virtual void getAnalysisUsage (AnalysisUsage& AU) const {
+            AU.setPreservesAll();
+        }
+
+        ModuleDriver() : ModulePass(ID) {}
+
+        virtual bool runOnModule (Module &M) {
+            if (Analysis == CONSTANTS && !canEmitConstants("-dataflow-module")) {
+                return false;
+            }
+
+            std::vector<Function*> functions;
+            for (auto &F : M) {
+                // arguments are built lazily, do it before any worker reads them
+                F.arg_begin();
+                if (!F.isDeclaration()) {
+                    functions.push_back(&F);
+                }
+            }
+
+            // every function prints into its own buffer. A buffer is written
+            // out as soon as the ones before it are, so the dump keeps module
+            // order and only the functions finished out of order are held
+            std::vector<std::string> output(functions.size());
+            std::vector<bool> done(functions.size());
+            std::mutex writing;
+            unsigned written = 0;
+            auto finished = [&](unsigned i) {
+                std::lock_guard<std::mutex> lock(writing);
+                done[i] = true;
+                for (; written < functions.size() && done[written]; ++written) {
+                    resultStream() << output[written];
+                    std::string().swap(output[written]);
+                }
+            };
+
+            // calls do not change available expressions or constants, those
+            // are solved per function as without summaries
+            if (Summaries && (Analysis == LIVENESS || Analysis == REACHING)) {
+                summarize(M, functions, output, finished);
+                resultStream().flush();
+                return false;
+            }
+
+            std::atomic<unsigned> next(0);
+            ThreadPool pool(hardware_concurrency(Threads));
+            for (unsigned t = 0; t < pool.getThreadCount(); ++t) {
+                pool.async([&]() {
+                    // one slot tracker per worker, the module is only numbered once
+                    ValueNamer namer(&M);
+                    for (unsigned i = next++; i < functions.size(); i = next++) {
+                        raw_string_ostream OS(output[i]);
+                        analyze(*functions[i], OS, namer);
+                        OS.flush();
+                        finished(i);
+                    }
+                });
+            }
+            pool.wait();
+            resultStream().flush();
+
+            return false;
+        }
+
+        private:
+        static void analyze (Function &F, raw_ostream &OS, ValueNamer &namer) {
+            switch (Analysis) {
+                case LIVENESS:
+                    printLiveness(F, OS, namer);
+                    break;
+                case REACHING:
+                    printReaching(F, OS, namer);
+                    break;
+                case AVAILABLE:
+                    printAvailable(F, OS, namer);
+                    break;
+                case CONSTANTS:
+                    printConstants(F, OS, namer);
+                    break;
+            }
+        }
+
+        // functions come back in call graph order from whichever worker
+        // solved them, each worker still gets its own namer
+        static void summarize (Module &M, ArrayRef<Function*> functions,
+            std::vector<std::string> &output, function_ref<void (unsigned)> finished) {
+            DenseMap<const Function*, unsigned> index;
+            for (unsigned i = 0; i < functions.size(); ++i) {
+                index[functions[i]] = i;
+            }
+
+            std::map<std::thread::id, std::unique_ptr<ValueNamer>> namers;
+            std::mutex naming;
+            auto namer = [&]() -> ValueNamer & {
+                std::lock_guard<std::mutex> lock(naming);
+                auto &namer = namers[std::this_thread::get_id()];
+                if (!namer) {
+                    namer.reset(new ValueNamer(&M));
+                }
+                return *namer;
+            };
+            auto print = [&](Function &F, const auto &info) {
+                unsigned i = index.lookup(&F);
+                raw_string_ostream OS(output[i]);
+                info.print(F, OS, namer());
+                OS.flush();
+                finished(i);
+            };
+
+            CallSummaries calls;
+            switch (Analysis) {
+                case LIVENESS:
+                    summarizeLiveness(M, calls, Threads, [&](Function &F, const LivenessInfo &info) {
+                        print(F, info);
+                    });
+                    break;
+                case REACHING:
+                    summarizeReaching(M, calls, Threads, [&](Function &F, const ReachingInfo &info) {
+                        print(F, info);
+                    });
+                    break;
+                case AVAILABLE:
+                case CONSTANTS:
+                    llvm_unreachable("only liveness and reaching have call summaries");
+            }
+        }
+    };
+
+    char ModuleDriver::ID = 0;
+    RegisterPass<ModuleDriver> X("dataflow-module", "Run a dataflow analysis on every function in parallel");
+}
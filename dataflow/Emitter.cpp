@@ -0,0 +1,345 @@
+#include "Emitter.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+
+namespace llvm {
+    static cl::opt<EmitFormat> Format("dataflow-format",
+        cl::desc("Format of the analysis dumps"),
+        cl::values(
+            clEnumValN(TEXT, "text", "the listing the passes always printed"),
+            clEnumValN(JSON_LINES, "json", "one JSON object per basic block"),
+            clEnumValN(BINARY, "binary", "versioned binary records, read by dataflow-read")),
+        cl::init(TEXT));
+
+    static cl::opt<std::string> Output("dataflow-output",
+        cl::desc("Write the analysis dumps to this file instead of stdout"),
+        cl::value_desc("file"), cl::init("-"));
+
+    EmitFormat emitFormat () {
+        return Format;
+    }
+
+    bool canEmitConstants (StringRef tool) {
+        if (Format != BINARY) {
+            return true;
+        }
+        errs() << tool << ": -dataflow-format=binary holds sets, print constants as text or json\n";
+        return false;
+    }
+
+    raw_ostream &resultStream () {
+        if (Output == "-") {
+            return outs();
+        }
+
+        // opened on first use and kept for every function after, its buffer
+        // is flushed when it is destroyed at exit
+        static std::unique_ptr<raw_fd_ostream> file;
+        if (!file) {
+            std::error_code EC;
+            file.reset(new raw_fd_ostream(Output, EC,
+                Format == BINARY ? sys::fs::OF_None : sys::fs::OF_Text));
+            if (EC) {
+                error("can not write " + Output + ": " + EC.message());
+            }
+            file->SetBufferSize(1 << 20);
+        }
+        return *file;
+    }
+
+    void ResultEmitter::nameValues (const Domain &domain) {
+        names.resize(domain.size());
+        for (unsigned i = 0; i < domain.size(); ++i) {
+            names[i] = namer.name(domain.get<Value>(i));
+        }
+    }
+
+    void ResultEmitter::numberValues (Function &F) {
+        positions.clear();
+        for (auto &arg : F.args()) {
+            positions[&arg] = positions.size();
+        }
+        for (auto &I : instructions(F)) {
+            positions[&I] = positions.size();
+        }
+    }
+
+    void ResultEmitter::valueIds (const Domain &domain) {
+        ids.resize(domain.size());
+        for (unsigned i = 0; i < domain.size(); ++i) {
+            ids[i] = positions.lookup(domain.get<Value>(i));
+        }
+    }
+
+    void ResultEmitter::record (results::RecordKind kind, Function &F,
+        const DataflowInfo &info, ArrayRef<unsigned> ids) {
+        RecordWriter writer(kind, F.getName(), info.getResult().transferCount);
+        for (unsigned i = 0; i < ids.size(); ++i) {
+            writer.value(ids[i], names[i]);
+        }
+        for (auto &BB : F) {
+            writer.block(BB.getName(), info.in(&BB), info.out(&BB));
+        }
+        writer.write(OS);
+    }
+
+    void ResultEmitter::beginFile (StringRef path) {
+        if (format == BINARY) {
+            RecordWriter::writeFile(OS, path);
+        } else if (format == JSON_LINES) {
+            json::OStream J(OS);
+            J.object([&]() {
+                J.attribute("file", path);
+            });
+            OS << "\n";
+        } else {
+            OS << "File: " << path << "\n";
+        }
+    }
+
+    void ResultEmitter::text (const VSet &facts, StringRef separator) {
+        for (auto i : facts.set_bits()) {
+            OS << names[i] << separator;
+        }
+    }
+
+    void ResultEmitter::array (json::OStream &J, StringRef key, const VSet &facts) {
+        J.attributeArray(key, [&]() {
+            for (auto i : facts.set_bits()) {
+                J.value(names[i]);
+            }
+        });
+    }
+
+    // fields every block has. The facts inside it follow where the text
+    // prints them, before each instruction for liveness and after it for
+    // available expressions, PHIs included so positions line up
+    void ResultEmitter::block (json::OStream &J, StringRef analysis, Function &F,
+        const BasicBlock &BB, const DataflowInfo &info) {
+        J.attribute("analysis", analysis);
+        J.attribute("function", F.getName());
+        J.attribute("block", BB.getName());
+        array(J, "in", info.in(&BB));
+        array(J, "out", info.out(&BB));
+    }
+
+    void ResultEmitter::emit (Function &F, const LivenessInfo &info) {
+        PhaseTimer timer("liveness", "print", F);
+        namer.incorporate(F);
+        nameValues(info.getDomain());
+
+        if (format == BINARY) {
+            numberValues(F);
+            valueIds(info.getDomain());
+            record(results::LIVENESS_RECORD, F, info, ids);
+            return;
+        }
+
+        if (format == JSON_LINES) {
+            for (auto &BB : F) {
+                info.blockPoints(&BB, points);
+                json::OStream J(OS);
+                J.object([&]() {
+                    block(J, "liveness", F, BB, info);
+                    J.attributeArray("before", [&]() {
+                        for (unsigned k = 0; k < BB.size(); ++k) {
+                            J.array([&]() {
+                                for (auto i : points[k].set_bits()) {
+                                    J.value(names[i]);
+                                }
+                            });
+                        }
+                    });
+                });
+                OS << "\n";
+            }
+            return;
+        }
+
+        OS << "Function: " << F.getName() << "\n";
+        OS << "Function: " << F.getName() << "\n";
+        for (auto &BB : F) {
+            info.blockPoints(&BB, points);
+            OS << "; " << BB.getName() << "\n";
+            unsigned k = 0;
+            for (auto &I : BB) {
+                namer.print(OS, I);
+                // PHINode is not a real node, so no need to add liveness behind it
+                if (!isa<PHINode>(I)) {
+                    OS << "  {";
+                    text(points[k], " ");
+                    OS << "}";
+                }
+                OS << "\n";
+                k++;
+            }
+
+            OS << "\n";
+        }
+    }
+
+    void ResultEmitter::emit (Function &F, const ReachingInfo &info) {
+        PhaseTimer timer("reaching", "print", F);
+        namer.incorporate(F);
+        nameValues(info.getDomain());
+
+        if (format == BINARY) {
+            numberValues(F);
+            valueIds(info.getDomain());
+            record(results::REACHING_RECORD, F, info, ids);
+            return;
+        }
+
+        if (format == JSON_LINES) {
+            for (auto &BB : F) {
+                json::OStream J(OS);
+                J.object([&]() {
+                    block(J, "reaching", F, BB, info);
+                });
+                OS << "\n";
+            }
+            return;
+        }
+
+        OS << "Function: " << F.getName() << "\n";
+        // output in/out
+        for (auto &BB : F) {
+            OS << "\n<" << BB.getName() << ">\n";
+            OS << "in: ";
+            text(info.in(&BB), " ");
+            OS <<"\nout: ";
+            text(info.out(&BB), " ");
+            OS << "\n";
+        }
+    }
+
+    void ResultEmitter::emit (Function &F, const AvailableInfo &info) {
+        PhaseTimer timer("available", "print", F);
+        namer.incorporate(F);
+        // expressions are named by their operands, not by an instruction
+        const ExpressionTable &table = info.getExpressions();
+        names.resize(table.size());
+        for (unsigned i = 0; i < table.size(); ++i) {
+            names[i] = table.get(i)->toString(namer);
+        }
+
+        if (format == BINARY) {
+            // an expression is known by the first instruction computing it
+            ids.assign(table.size(), ~0u);
+            unsigned position = F.arg_size();
+            for (auto &I : instructions(F)) {
+                Index i = table.find(&I);
+                if (i != Domain::NOT_FOUND && ids[i] == ~0u) {
+                    ids[i] = position;
+                }
+                position++;
+            }
+            record(results::AVAILABLE_RECORD, F, info, ids);
+            return;
+        }
+
+        if (format == JSON_LINES) {
+            for (auto &BB : F) {
+                info.blockPoints(&BB, points);
+                json::OStream J(OS);
+                J.object([&]() {
+                    block(J, "available", F, BB, info);
+                    J.attributeArray("after", [&]() {
+                        for (unsigned k = 1; k <= BB.size(); ++k) {
+                            J.array([&]() {
+                                for (auto i : points[k].set_bits()) {
+                                    J.value(names[i]);
+                                }
+                            });
+                        }
+                    });
+                });
+                OS << "\n";
+            }
+            return;
+        }
+
+        OS << "Function: " << F.getName() << "\n";
+        // output the result
+        int index = 0;
+        for (auto &BB : F) {
+            info.blockPoints(&BB, points);
+            OS << "\n<" << BB.getName() << ">\n";
+            unsigned k = 1;
+            for (auto &I : BB) {
+                OS << index << ": ";
+                namer.print(OS, I);
+
+                // pretty print
+                OS << "\t{";
+                text(points[k], ", ");
+                OS << "}\n";
+
+                index++;
+                k++;
+            }
+        }
+    }
+
+    std::string ResultEmitter::constant (const ConstantInfo &info, Index i) {
+        ConstantValue value = info.getValues()[i];
+        if (value.isUndefined()) {
+            return "undefined";
+        }
+        if (value.isOverdefined()) {
+            return "overdefined";
+        }
+        return namer.operand(info.constant(i));
+    }
+
+    void ResultEmitter::constants (json::OStream &J, const ConstantInfo &info, const BasicBlock &BB) {
+        J.attributeObject("constants", [&]() {
+            for (auto &I : BB) {
+                Index i = info.getDomain().find(&I);
+                if (i != Domain::NOT_FOUND && info.getValues()[i].isConstant()) {
+                    J.attribute(names[i], constant(info, i));
+                }
+            }
+        });
+    }
+
+    void ResultEmitter::emit (Function &F, const ConstantInfo &info) {
+        PhaseTimer timer("constants", "print", F);
+        namer.incorporate(F);
+        nameValues(info.getDomain());
+
+        if (format == BINARY) {
+            return;
+        }
+
+        if (format == JSON_LINES) {
+            for (auto &BB : F) {
+                json::OStream J(OS);
+                J.object([&]() {
+                    J.attribute("analysis", "constants");
+                    J.attribute("function", F.getName());
+                    J.attribute("block", BB.getName());
+                    J.attribute("executable", info.isExecutable(&BB));
+                    constants(J, info, BB);
+                });
+                OS << "\n";
+            }
+            return;
+        }
+
+        OS << "Function: " << F.getName() << "\n";
+        // every value at its definition
+        for (auto &BB : F) {
+            OS << "\n<" << BB.getName() << ">\n";
+            for (auto &I : BB) {
+                namer.print(OS, I);
+                Index i = info.getDomain().find(&I);
+                if (i != Domain::NOT_FOUND) {
+                    OS << "\t{" << constant(info, i) << "}";
+                }
+                OS << "\n";
+            }
+        }
+    }
+}
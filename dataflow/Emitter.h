@@ -0,0 +1,76 @@
+#ifndef DATAFLOW_EMITTER_H
+#define DATAFLOW_EMITTER_H
+
+#include "Passes.h"
+#include "ResultFile.h"
+
+#include "llvm/Support/JSON.h"
+
+namespace llvm {
+	// formats of the result dumps
+	enum EmitFormat {
+		TEXT,
+		JSON_LINES,
+		BINARY
+	};
+
+	// -dataflow-format, text by default
+	EmitFormat emitFormat ();
+	// binary records only hold sets, false with a note on errs() from tool
+	// when constants would be written as binary
+	bool canEmitConstants (StringRef tool);
+	// -dataflow-output, the stream dumps go to, stdout by default
+	raw_ostream &resultStream ();
+
+	// streams the results of one function after another. The names of a
+	// domain are built once per function, and the facts inside a block are
+	// stepped into one reused vector of sets, so time and output grow
+	// linearly with the instructions and facts written. Text is what the
+	// passes always printed, JSON lines have one object per block and binary
+	// one record per function, see ResultFile.h
+	class ResultEmitter {
+		public:
+		ResultEmitter (raw_ostream &OS, ValueNamer &namer, EmitFormat format = emitFormat())
+		: OS(OS), namer(namer), format(format)
+		{
+
+		};
+
+		void emit (Function &F, const LivenessInfo &info);
+		void emit (Function &F, const ReachingInfo &info);
+		void emit (Function &F, const AvailableInfo &info);
+		// constants are text or JSON, nothing is written in binary, the
+		// tools turn that down with canEmitConstants
+		void emit (Function &F, const ConstantInfo &info);
+		// dataflow-batch, the functions after it come from path
+		void beginFile (StringRef path);
+
+		private:
+		// names[i] for every value of the domain
+		void nameValues (const Domain &domain);
+		void text (const VSet &facts, StringRef separator);
+		void array (json::OStream &J, StringRef key, const VSet &facts);
+		// undefined, overdefined or the constant
+		std::string constant (const ConstantInfo &info, Index i);
+		// the values defined in BB that are constants, by name
+		void constants (json::OStream &J, const ConstantInfo &info, const BasicBlock &BB);
+		void block (json::OStream &J, StringRef analysis, Function &F, const BasicBlock &BB,
+			const DataflowInfo &info);
+		// one record, ids[i] is the stable id of domain entry i
+		void record (results::RecordKind kind, Function &F, const DataflowInfo &info,
+			ArrayRef<unsigned> ids);
+		// position of every argument and instruction of F, the stable ids
+		void numberValues (Function &F);
+		void valueIds (const Domain &domain);
+
+		raw_ostream &OS;
+		ValueNamer &namer;
+		EmitFormat format;
+		std::vector<std::string> names;
+		std::vector<VSet> points;
+		DenseMap<const Value*, unsigned> positions;
+		std::vector<unsigned> ids;
+	};
+};
+
+#endif
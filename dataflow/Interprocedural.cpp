@@ -0,0 +1,276 @@
+#include "Passes.h"
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+
+#define DEBUG_TYPE "dataflow"
+
+namespace llvm {
+    static cl::opt<unsigned> SummaryRounds("dataflow-summary-rounds",
+        cl::desc("Times the functions of a recursive call graph SCC are solved before "
+            "their summaries give up"),
+        cl::init(8));
+
+    static TrackingStatistic NumSccs = {DEBUG_TYPE, "NumSccs", "Call graph SCCs summarized"};
+    static TrackingStatistic NumSummarySolves = {DEBUG_TYPE, "NumSummarySolves",
+        "Functions solved while summarizing"};
+    static TrackingStatistic NumSummaryGiveUps = {DEBUG_TYPE, "NumSummaryGiveUps",
+        "Recursive SCCs whose summaries did not settle in time"};
+
+    const CallSummary *CallSummaries::lookup (const Function *F) const {
+        if (!F) {
+            return nullptr;
+        }
+        auto it = summaries.find(F);
+        return it == summaries.end() ? nullptr : &it->second;
+    }
+
+    bool CallSummaries::reads (const Use &U) const {
+        auto call = dyn_cast<CallBase>(U.getUser());
+        if (!call || !call->isArgOperand(&U)) {
+            return true;
+        }
+
+        const CallSummary *summary = lookup(call->getCalledFunction());
+        unsigned arg = call->getArgOperandNo(&U);
+        // variadic arguments are beyond the summary
+        return !summary || arg >= summary->liveArgs.size() || summary->liveArgs.test(arg);
+    }
+
+    void CallSummaries::stores (const Instruction &I, SmallVectorImpl<Value*> &pointers) const {
+        auto call = dyn_cast<CallBase>(&I);
+        if (!call) {
+            return;
+        }
+
+        const CallSummary *summary = lookup(call->getCalledFunction());
+        if (!summary) {
+            return;
+        }
+        for (auto arg : summary->storedArgs.set_bits()) {
+            if (arg < call->arg_size()) {
+                pointers.push_back(call->getArgOperand(arg));
+            }
+        }
+    }
+
+    namespace {
+        // the summary one analysis builds. Iteration starts from least, which
+        // is exact for functions outside recursion, and only grows, so a
+        // recursive SCC settles within a round per argument. opaque is what
+        // an unknown callee does, always safe
+        struct LivenessSummary {
+            typedef LivenessInfo Info;
+
+            static Info solve (Function &F, const CallSummaries &calls) {
+                return computeLiveness(F, calls);
+            }
+            static void least (Function &F, CallSummary &summary) {
+                summary.liveArgs = BitVector(F.arg_size());
+            }
+            static void opaque (Function &F, CallSummary &summary) {
+                summary.liveArgs = BitVector(F.arg_size(), true);
+            }
+            static bool update (Function &F, const Info &info, CallSummary &summary) {
+                BitVector live(F.arg_size());
+                for (auto &arg : F.args()) {
+                    if (info.isLiveIn(&arg, &F.getEntryBlock())) {
+                        live.set(arg.getArgNo());
+                    }
+                }
+                bool changed = live != summary.liveArgs;
+                summary.liveArgs = std::move(live);
+                return changed;
+            }
+        };
+
+        struct ReachingSummary {
+            typedef ReachingInfo Info;
+
+            static Info solve (Function &F, const CallSummaries &calls) {
+                return computeReaching(F, calls);
+            }
+            static void least (Function &F, CallSummary &summary) {
+                summary.storedArgs = BitVector(F.arg_size());
+            }
+            static void opaque (Function &F, CallSummary &summary) {
+                least(F, summary);
+            }
+            // a pointer argument is stored through when its definition
+            // reaches none of the returns. A function that never returns
+            // stores through nothing
+            static bool update (Function &F, const Info &info, CallSummary &summary) {
+                SmallVector<BasicBlock*, 4> returns;
+                for (auto &BB : F) {
+                    if (isa<ReturnInst>(BB.getTerminator())) {
+                        returns.push_back(&BB);
+                    }
+                }
+
+                BitVector stored(F.arg_size());
+                for (auto &arg : F.args()) {
+                    if (returns.empty() || !arg.getType()->isPointerTy()) {
+                        continue;
+                    }
+                    bool reaches = false;
+                    for (auto BB : returns) {
+                        reaches |= info.reachesOut(&arg, BB);
+                    }
+                    if (!reaches) {
+                        stored.set(arg.getArgNo());
+                    }
+                }
+                bool changed = stored != summary.storedArgs;
+                summary.storedArgs = std::move(stored);
+                return changed;
+            }
+        };
+
+        struct Scc {
+            std::vector<Function*> functions;
+            bool recursive = false;
+            // SCCs calling into this one, they wait for it
+            std::vector<unsigned> callers;
+            unsigned callees = 0;
+        };
+
+        // SCCs of the defined functions, callees before their callers
+        std::vector<Scc> callGraphSccs (Module &M) {
+            CallGraph CG(M);
+            std::vector<Scc> sccs;
+            DenseMap<const Function*, unsigned> sccOf;
+            for (auto it = scc_begin(&CG); !it.isAtEnd(); ++it) {
+                Scc scc;
+                for (CallGraphNode *node : *it) {
+                    Function *F = node->getFunction();
+                    if (F && !F->isDeclaration()) {
+                        scc.functions.push_back(F);
+                    }
+                }
+                if (scc.functions.empty()) {
+                    continue;
+                }
+
+                scc.recursive = it.hasCycle();
+                for (auto F : scc.functions) {
+                    sccOf[F] = sccs.size();
+                }
+                sccs.push_back(std::move(scc));
+            }
+
+            for (unsigned s = 0; s < sccs.size(); ++s) {
+                SmallDenseSet<unsigned, 8> callees;
+                for (auto F : sccs[s].functions) {
+                    for (auto &record : *CG[F]) {
+                        auto it = sccOf.find(record.second->getFunction());
+                        if (it != sccOf.end() && it->second != s && callees.insert(it->second).second) {
+                            sccs[it->second].callers.push_back(s);
+                        }
+                    }
+                }
+                sccs[s].callees = callees.size();
+            }
+            return sccs;
+        }
+
+        template<typename Summary> void summarize (Module &M, CallSummaries &calls, unsigned threads,
+            function_ref<void (Function &, const typename Summary::Info &)> done) {
+            typedef typename Summary::Info Info;
+            std::vector<Scc> sccs = callGraphSccs(M);
+
+            // every entry exists before the workers start, they only change
+            // the summaries of their own SCC
+            for (auto &F : M) {
+                if (!F.isDeclaration()) {
+                    CallSummary &summary = calls[&F];
+                    LivenessSummary::opaque(F, summary);
+                    ReachingSummary::opaque(F, summary);
+                    Summary::least(F, summary);
+                }
+            }
+
+            auto solveScc = [&](Scc &scc) {
+                NumSccs++;
+                if (!scc.recursive) {
+                    Function &F = *scc.functions[0];
+                    Info info = Summary::solve(F, calls);
+                    NumSummarySolves++;
+                    Summary::update(F, info, calls[&F]);
+                    done(F, info);
+                    return;
+                }
+
+                // every member is solved with the newest summaries of the
+                // others, a round where none of them changed is final
+                std::vector<Info> results(scc.functions.size());
+                for (unsigned round = 0; ; ++round) {
+                    bool changed = false;
+                    for (unsigned i = 0; i < scc.functions.size(); ++i) {
+                        Function &F = *scc.functions[i];
+                        results[i] = Summary::solve(F, calls);
+                        NumSummarySolves++;
+                        changed |= Summary::update(F, results[i], calls[&F]);
+                    }
+                    if (!changed) {
+                        break;
+                    }
+
+                    if (round + 1 >= SummaryRounds) {
+                        NumSummaryGiveUps++;
+                        for (auto F : scc.functions) {
+                            Summary::opaque(*F, calls[F]);
+                        }
+                        for (unsigned i = 0; i < scc.functions.size(); ++i) {
+                            results[i] = Summary::solve(*scc.functions[i], calls);
+                            NumSummarySolves++;
+                        }
+                        break;
+                    }
+                }
+
+                for (unsigned i = 0; i < scc.functions.size(); ++i) {
+                    done(*scc.functions[i], results[i]);
+                }
+            };
+
+            // an SCC is ready once all the SCCs it calls are done
+            std::unique_ptr<std::atomic<unsigned>[]> waiting(new std::atomic<unsigned>[sccs.size()]);
+            for (unsigned s = 0; s < sccs.size(); ++s) {
+                waiting[s] = sccs[s].callees;
+            }
+
+            ThreadPool pool(hardware_concurrency(threads));
+            std::function<void (unsigned)> run = [&](unsigned s) {
+                solveScc(sccs[s]);
+                for (unsigned caller : sccs[s].callers) {
+                    if (--waiting[caller] == 0) {
+                        pool.async(run, caller);
+                    }
+                }
+            };
+            for (unsigned s = 0; s < sccs.size(); ++s) {
+                if (sccs[s].callees == 0) {
+                    pool.async(run, s);
+                }
+            }
+            pool.wait();
+        }
+    }
+
+    void summarizeLiveness (Module &M, CallSummaries &calls, unsigned threads,
+        function_ref<void (Function &, const LivenessInfo &)> done) {
+        summarize<LivenessSummary>(M, calls, threads, done);
+    }
+
+    void summarizeReaching (Module &M, CallSummaries &calls, unsigned threads,
+        function_ref<void (Function &, const ReachingInfo &)> done) {
+        summarize<ReachingSummary>(M, calls, threads, done);
+    }
+}
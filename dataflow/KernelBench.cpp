@@ -0,0 +1,129 @@
+#include "BitKernels.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+
+#include <chrono>
+#include <random>
+
+using namespace llvm;
+namespace {
+    static cl::opt<unsigned> Inputs("inputs",
+        cl::desc("Sets met by every call, the predecessors of a block"),
+        cl::init(4));
+
+    static cl::opt<bool> Intersect("intersect",
+        cl::desc("Meet by intersection instead of union"),
+        cl::init(false));
+
+    static cl::opt<unsigned> Work("work",
+        cl::desc("Millions of words streamed per measurement"),
+        cl::init(64));
+
+    // domain sizes, from a small function to reaching definitions in a big one
+    const unsigned Sizes[] = {256, 4096, 32768, 262144};
+
+    struct Sets {
+        std::vector<VSet> inputs;
+        VSet gen, kill, input, output;
+    };
+
+    Sets randomSets (unsigned bits, std::mt19937 &rng) {
+        auto random = [&]() {
+            VSet set(bits);
+            for (unsigned i = 0; i < bits; ++i) {
+                if (rng() % 4 == 0) {
+                    set.set(i);
+                }
+            }
+            return set;
+        };
+
+        Sets sets;
+        for (unsigned i = 0; i < Inputs; ++i) {
+            sets.inputs.push_back(random());
+        }
+        sets.gen = random();
+        sets.kill = random();
+        sets.input = VSet(bits);
+        sets.output = VSet(bits);
+        return sets;
+    }
+
+    // nanoseconds per call of one meet + transfer
+    template<typename Step> double timeCalls (unsigned calls, Step step) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned c = 0; c < calls; ++c) {
+            step();
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / calls;
+    }
+}
+
+// dataflow-kernel-bench: time the fused meet + gen/kill kernel on every
+// instruction set the host supports, against BitVector operations
+int main (int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "dataflow bit-set kernel benchmark\n");
+    if (Inputs == 0) {
+        errs() << argv[0] << ": -inputs must be at least 1\n";
+        return 1;
+    }
+
+    MeetOp op = Intersect ? INTERSECT : UNION;
+    std::mt19937 rng(1);
+    bool agree = true;
+    outs() << "bits\tinputs\tkernel\tns/call\tspeedup\n";
+    for (unsigned bits : Sizes) {
+        Sets sets = randomSets(bits, rng);
+        SmallVector<const VSet*, 8> inputs;
+        for (auto &set : sets.inputs) {
+            inputs.push_back(&set);
+        }
+
+        uint64_t words = (uint64_t) (bits + 63) / 64 * (Inputs + 4);
+        unsigned calls = std::max<uint64_t>(1, (uint64_t) Work * 1000000 / words);
+
+        // what the solver did before the kernels: meet one input at a time,
+        // then kill, gen and compare as separate passes
+        VSet expected;
+        double baseline = timeCalls(calls, [&]() {
+            sets.input = *inputs[0];
+            for (unsigned i = 1; i < inputs.size(); ++i) {
+                op == UNION ? sets.input |= *inputs[i] : sets.input &= *inputs[i];
+            }
+            expected = sets.input;
+            expected.reset(sets.kill);
+            expected |= sets.gen;
+            if (expected != sets.output) {
+                sets.output = expected;
+            }
+        });
+        outs() << bits << "\t" << Inputs << "\tbitvector\t" << format("%.1f\t-\n", baseline);
+
+        double scalar = 0;
+        for (KernelIsa isa : {SCALAR, SSE2, AVX2}) {
+            if (!setKernelIsa(isa)) {
+                continue;
+            }
+
+            sets.output.reset();
+            double time = timeCalls(calls, [&]() {
+                meetGenKill(op, inputs, sets.gen, sets.kill, sets.input, sets.output);
+            });
+            if (sets.output != expected) {
+                errs() << kernelName(isa) << " kernel is wrong on " << bits << " bits\n";
+                agree = false;
+            }
+            if (isa == SCALAR) {
+                scalar = time;
+            }
+            outs() << bits << "\t" << Inputs << "\t" << kernelName(isa) << "\t"
+                << format("%.1f\t%.2fx\n", time, scalar / time);
+        }
+    }
+
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+#ifndef DATAFLOW_LATTICE_H
+#define DATAFLOW_LATTICE_H
+
+#include "Dataflow.h"
+
+#include <cstring>
+#include <type_traits>
+
+namespace llvm {
+	// analyses whose facts are not subsets of a domain run on the same
+	// DataflowSolver with a LatticeVector as its lattice: one element per
+	// domain entry, over a join-semilattice given by Element
+	//
+	//   static Element bottom ()
+	//     the least element, nothing known yet
+	//   static Element join (Element a, Element b)
+	//     least upper bound
+	//   static bool leq (Element a, Element b)
+	//     the ordering, a is below or equal to b
+	//   static Element widen (Element old, Element next)
+	//     an upper bound of both, repeated widening has to stop growing.
+	//     Lattices of finite height can return the join
+	//
+	// Elements should be a byte or a few with no padding, a block's value is
+	// one flat array of them, joined in a single pass and compared and
+	// copied as memory
+	template<typename Element> class LatticeVector {
+		static_assert(std::is_trivially_copyable<Element>::value, "elements are compared as bytes");
+
+		public:
+		LatticeVector () {}
+		explicit LatticeVector (unsigned size) : elements(size, Element::bottom()) {}
+
+		unsigned size () const { return elements.size(); }
+		// entries added by a grown domain start at bottom
+		void resize (unsigned size) { elements.resize(size, Element::bottom()); }
+		// size elements at bottom, keeping the storage
+		void clear (unsigned size) { elements.assign(size, Element::bottom()); }
+		// copy from over this, true if this changed
+		bool assign (const LatticeVector &from) {
+			if (*this == from) {
+				return false;
+			}
+			elements = from.elements;
+			return true;
+		}
+
+		Element &operator[] (unsigned i) { return elements[i]; }
+		const Element &operator[] (unsigned i) const { return elements[i]; }
+
+		// join from into this, true if this changed. Elements of a byte alias
+		// everything, the loops work on locals so they still vectorize
+		bool join (const LatticeVector &from) {
+			assert(size() == from.size() && "joining lattices over different domains");
+			Element *into = elements.data();
+			const Element *other = from.elements.data();
+			unsigned n = size();
+			bool changed = false;
+			for (unsigned i = 0; i < n; ++i) {
+				Element joined = Element::join(into[i], other[i]);
+				changed |= !(joined == into[i]);
+				into[i] = joined;
+			}
+			return changed;
+		}
+		// the solver adds edge facts with |=
+		LatticeVector &operator|= (const LatticeVector &from) {
+			join(from);
+			return *this;
+		}
+
+		bool leq (const LatticeVector &other) const {
+			const Element *below = elements.data(), *above = other.elements.data();
+			unsigned n = size();
+			for (unsigned i = 0; i < n; ++i) {
+				if (!Element::leq(below[i], above[i])) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// widen the elements that grew past previous, true if any did
+		bool widen (const LatticeVector &previous) {
+			Element *next = elements.data();
+			const Element *old = previous.elements.data();
+			unsigned n = size();
+			bool widened = false;
+			for (unsigned i = 0; i < n; ++i) {
+				if (!Element::leq(next[i], old[i])) {
+					next[i] = Element::widen(old[i], next[i]);
+					widened = true;
+				}
+			}
+			return widened;
+		}
+
+		bool operator== (const LatticeVector &other) const {
+			return size() == other.size()
+				&& !memcmp(elements.data(), other.elements.data(), size() * sizeof(Element));
+		}
+		bool operator!= (const LatticeVector &other) const { return !(*this == other); }
+
+		// elements above bottom, what the solver statistics count
+		unsigned count () const {
+			unsigned known = 0;
+			for (auto &element : elements) {
+				known += !(element == Element::bottom());
+			}
+			return known;
+		}
+
+		size_t capacityInBytes () const { return elements.capacity() * sizeof(Element); }
+
+		private:
+		std::vector<Element> elements;
+	};
+
+	template<typename Element> size_t capacity_in_bytes (const LatticeVector<Element> &value) {
+		return value.capacityInBytes();
+	}
+
+	// meet of a lattice analysis, the join of what flows in
+	struct JoinMeet {
+		template<typename Lattice> static void meet (Lattice &into, const Lattice &from) {
+			into.join(from);
+		}
+	};
+
+	// transfer policy for lattice analyses, the counterpart of GenKillTransfer
+	// (Solver.h). Derived provides
+	//
+	//   bool transfer (BasicBlock *BB, const Lattice &input, Lattice &output,
+	//       std::map<BasicBlock*, Lattice> &neighbor)
+	//     the output and edge facts of BB for its input, updated in place,
+	//     true if either changed
+	//
+	// The meet of the inputs is taken here, and the transfer only runs on a
+	// block's first visit or when its input changed, so it has to depend on
+	// nothing else. Once a block has been visited -dataflow-widen-after
+	// times, every element of its input that still grows is widened from the
+	// previous input, so lattices of infinite height converge too
+	template<typename Derived, typename Element> class LatticeTransfer {
+		public:
+		typedef LatticeVector<Element> Lattice;
+
+		LatticeTransfer (unsigned size) : size(size), widenAfter(llvm::widenAfter()) {}
+
+		Lattice emptySet () const { return Lattice(size); }
+		void fit (Lattice &value) const { value.resize(size); }
+
+		// a changed block starts counting its visits again
+		void invalidate (Function &, ArrayRef<BasicBlock*> stale) {
+			for (auto BB : stale) {
+				visits.erase(BB);
+			}
+		}
+
+		size_t bytesUsed () const {
+			return capacity_in_bytes(visits) + capacity_in_bytes(merged);
+		}
+
+		template<typename Meet> bool meetTransfer (BasicBlock *BB, ArrayRef<const Lattice*> inputs,
+			Lattice &input, Lattice &output, std::map<BasicBlock*, Lattice> &neighbor) {
+			// one pass per input, most blocks have one or two
+			merged = *inputs[0];
+			for (unsigned i = 1; i < inputs.size(); ++i) {
+				Meet::meet(merged, *inputs[i]);
+			}
+
+			// nothing new flows in, most revisits in a loop
+			unsigned visit = ++visits[BB];
+			if (visit > 1 && merged == input) {
+				return false;
+			}
+			if (visit > widenAfter && input.size() == merged.size()) {
+				merged.widen(input);
+			}
+			// the old input is the next meet's storage
+			std::swap(input, merged);
+
+			return static_cast<Derived*>(this)->transfer(BB, input, output, neighbor);
+		}
+
+		protected:
+		unsigned size;
+
+		private:
+		unsigned widenAfter;
+		DenseMap<BasicBlock*, unsigned> visits;
+		// the meet being built, reused across blocks
+		Lattice merged;
+	};
+};
+
+#endif
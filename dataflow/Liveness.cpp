@@ -1,154 +1,262 @@
-#include "Dataflow.h"
+#include "Cache.h"
+#include "Emitter.h"
+#include "Solver.h"
+
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 namespace {
-    class Liveness : public FunctionPass {
+    class LivenessTransfer : public GenKillTransfer<LivenessTransfer> {
         public:
-        static char ID;
-        
-        virtual void getAnalysisUsage (AnalysisUsage& AU) const {
-            AU.setPreservesAll();
-        }
+        LivenessTransfer (const Domain &domain, const CallSummaries *calls = nullptr)
+        : GenKillTransfer(domain), calls(calls) {}
 
-        Liveness() : FunctionPass(ID) { }
-
-        virtual bool runOnFunction (Function &F) {
-            outs() << "Function: " << F.getName() << "\n";
-            DataFlowResult result;
-            Domain domain;
+        // use is gen, def is kill
+        BlockSummary summarize (BasicBlock *curr) {
+            BlockSummary output;
+            VSet &use = output.gen, &def = output.kill;
 
-            // add all used values to the set
-            for (auto I = inst_begin(F); I != inst_end(F); ++I) {
-                if (Instruction* inst = dyn_cast<Instruction> (&*I)) {
-                    for (auto OI = inst->op_begin(); OI != inst->op_end(); ++OI) {
-                        Value *val = *OI;
-
-                        if (isa<Instruction> (val) || isa<Argument> (val)) {
-                            if (std::find(domain.begin(), domain.end(), val) == domain.end()) {
-                                domain.push_back(val);
+            use = emptySet();
+            def = emptySet();
+            for (auto inst = curr->begin(); inst != curr->end(); ++inst) {
+                if (PHINode *phi = dyn_cast<PHINode> (&*inst)) {
+                    for (int i = 0; i < phi->getNumIncomingValues(); ++i) {
+                        auto val = phi->getIncomingValue(i);
+                        if (isa<Instruction>(val) || isa<Argument>(val)) {
+                            // add instructions to neighbor
+                            auto incomingBlock = phi->getIncomingBlock(i);
+                            if (output.neighbor.find(incomingBlock) == output.neighbor.end()) {
+                                output.neighbor.insert(std::pair<BasicBlock*, VSet>(incomingBlock, emptySet()));
                             }
+
+                            Index index = domainIndex(val);
+                            output.neighbor[incomingBlock].set(index);
                         }
                     }
-                }
-            }
-
-            // initialize analysis
-            Analysis analysis  = Analysis(Direction::BACKWARD, MeetOp::UNION, domain);
-            VSet boudary = VSet(), interior = VSet();
-            result = analysis.run(F, boudary, interior);
-
-            outs() << "Function: " << F.getName() << "\n";
-            // We have got in/out for each block, now we need to analyze each instruction
-            for (auto &BB : F) {
-                outs() << "; " << BB.getName() << "\n";
-                VSet live = result.result[&BB].out;
-                std::vector<std::pair<Instruction *,std::string>> output;
-                for (auto inst = BB.rbegin(); inst != BB.rend(); ++inst) {
-                    Instruction *I = &*inst;
-                    // PHINode is not a real node, so no need to add liveness behind it
-                    if (auto phi = dyn_cast<PHINode>(&*inst)) {
-                        Index i = analysis.domainIndex(phi);
-                        auto LHS = live.find(i);
-                        // if something has been redefines, killed it
-                        if (LHS != live.end()) {
-                            live.erase(LHS);
+                } else {
+                    for (auto op = inst->op_begin(); op != inst->op_end(); ++op) {
+                        Value *val = *op;
+                        // an argument the callee never reads is no use
+                        if (calls && !calls->reads(*op)) {
+                            continue;
                         }
-                        output.push_back(std::pair<Instruction*, std::string>(I, ""));
-                    } else {
-                        for (auto op = inst->op_begin(); op != inst->op_end(); ++op) {
-                            Value *val = *op;
-                            // find live varaible 
-                            if (isa<Instruction>(val) || isa<Argument>(val)) {
-                                Index i = analysis.domainIndex(val);
-                                if (i != analysis.INDEX_NOT_FOUND) {
-                                    live.insert(i);
+                        if (isa<Instruction> (val) || isa<Argument> (val)) {
+                            // if previous defined and used now, add to use set
+                            Index index = domainIndex(val);
+                            if (index != INDEX_NOT_FOUND) {
+                                if (!def.test(index)) {
+                                    use.set(index);
                                 }
                             }
                         }
-
-                        // killed the redefined varaible
-                        Index i = analysis.domainIndex(&*inst);
-                        auto iter = live.find(i);
-                        if (iter != live.end()) {
-                            live.erase(iter);
-                        }
-
-                        // pretty print  
-                        std::string s = "  {";
-                        for (auto val : live) {
-                            s += getValueName((Value *) analysis.domain[val]);
-                            s += " ";
-                        }
-                        s += "}";
-                        output.push_back(std::pair<Instruction*, std::string>(I, s));
                     }
                 }
 
-                for (auto o = output.rbegin(); o != output.rend(); ++o) {
-                    outs() << *o->first << o->second << "\n";
+                // insert to defined set
+                Index i = domainIndex(&*inst);
+                if (i != INDEX_NOT_FOUND) {
+                    def.set(i);
                 }
-
-                outs() << "\n";
             }
-            return false;
+
+            return output;
         }
 
         private:
-        class Analysis : public Dataflow {
-            public:
-            Analysis (Direction direction, MeetOp meetop, Domain domain)
-                : Dataflow (direction, meetop, domain) {}
-            
-            TransferOutput transferFn (VSet input, BasicBlock *curr) {
-                TransferOutput output;
-
-                VSet use, def;
-                for (auto inst = curr->begin(); inst != curr->end(); ++inst) {
-                    if (PHINode *phi = dyn_cast<PHINode> (&*inst)) {
-                        for (int i = 0; i < phi->getNumIncomingValues(); ++i) {
-                            auto val = phi->getIncomingValue(i);
-                            if (isa<Instruction>(val) || isa<Argument>(val)) {
-                                // add instructions to neighbor
-                                auto incomingBlock = phi->getIncomingBlock(i);
-                                if (output.neighbor.find(incomingBlock) == output.neighbor.end()) {
-                                    output.neighbor.insert(std::pair<BasicBlock*, VSet>(incomingBlock, VSet()));
-                                }
-                                
-                                Index index = domainIndex(val);
-                                output.neighbor[incomingBlock].insert(index);
-                            }
-                        }
-                    } else {
-                        for (auto op = inst->op_begin(); op != inst->op_end(); ++op) {
-                            Value *val = *op;
-                            if (isa<Instruction> (val) || isa<Argument> (val)) {
-                                // if previous defined and used now, add to use set
-                                Index index = domainIndex(val);
-                                if (index != INDEX_NOT_FOUND) {
-                                    if (def.find(index) == def.end()) {
-                                        use.insert(index);
-                                    }
-                                }
-                            }
-                        }
+        const CallSummaries *calls;
+    };
+
+    // every value used as an operand
+    Domain usedValues (Function &F) {
+        Domain domain;
+        PhaseTimer domainTimer("liveness", "domain", F);
+
+        // add all used values to the set
+        for (auto I = inst_begin(F); I != inst_end(F); ++I) {
+            if (Instruction* inst = dyn_cast<Instruction> (&*I)) {
+                for (auto OI = inst->op_begin(); OI != inst->op_end(); ++OI) {
+                    Value *val = *OI;
+
+                    if (isa<Instruction> (val) || isa<Argument> (val)) {
+                        domain.insert(val);
                     }
-                    
-                    // insert to defined set
-                    Index i = domainIndex(&*inst);
-                    if (i != INDEX_NOT_FOUND) {
-                        def.insert(i);
+                }
+            }
+        }
+
+        return domain;
+    }
+
+    static cl::opt<LivenessEngine> Engine("liveness-engine",
+        cl::desc("Solver used for liveness"),
+        cl::values(
+            clEnumValN(ITERATIVE, "iterative", "Iterate the bit-set equations over every block"),
+            clEnumValN(SPARSE, "sparse", "Walk from each use back to its SSA definition")),
+        cl::init(ITERATIVE));
+
+    // SSA liveness one value at a time: a use makes the value live into its
+    // block, a PHI use live out of the incoming block, and it then flows to
+    // predecessors until the defining block. Only blocks the value is live in
+    // are visited, instead of iterating every block over the whole domain
+    DataFlowResult sparseLiveness (Function &F, const Domain &domain) {
+        DataFlowResult output;
+        output.numberBlocks(F);
+        for (auto &block : output.values) {
+            block.in = VSet(domain.size());
+            block.out = VSet(domain.size());
+        }
+
+        SmallVector<BasicBlock*, 16> worklist;
+        for (Index v = 0; v < (Index)domain.size(); ++v) {
+            const Value *val = domain.get<Value>(v);
+            const Instruction *def = dyn_cast<Instruction>(val);
+            const BasicBlock *defBlock = def ? def->getParent() : nullptr;
+
+            auto liveIn = [&](BasicBlock *BB) {
+                BlockResult &block = output.at(BB);
+                if (!block.in.test(v)) {
+                    block.in.set(v);
+                    worklist.push_back(BB);
+                }
+            };
+            auto liveOut = [&](BasicBlock *BB) {
+                BlockResult &block = output.at(BB);
+                if (!block.out.test(v)) {
+                    block.out.set(v);
+                    // the definition kills it, so it is not live above
+                    if (BB != defBlock) {
+                        liveIn(BB);
                     }
                 }
+            };
+
+            for (const Use &U : val->uses()) {
+                Instruction *user = dyn_cast<Instruction>(U.getUser());
+                if (!user) {
+                    continue;
+                }
+                if (PHINode *phi = dyn_cast<PHINode>(user)) {
+                    liveOut(phi->getIncomingBlock(U));
+                } else if (user->getParent() != defBlock || !def->comesBefore(user)) {
+                    // used before (or without) a definition in this block
+                    liveIn(user->getParent());
+                }
+            }
 
-                // (input - def) U use
-                auto tmp = substractSet(input, def);
-                output.transfer = unionSet(use, tmp);
-                return output;
+            while (!worklist.empty()) {
+                BasicBlock *BB = worklist.pop_back_val();
+                for (BasicBlock *pred : predecessors(BB)) {
+                    liveOut(pred);
+                }
             }
-        };
+        }
+
+        return output;
+    }
+
+    class Liveness : public FunctionPass {
+        public:
+        static char ID;
+
+        virtual void getAnalysisUsage (AnalysisUsage& AU) const {
+            AU.setPreservesAll();
+        }
+
+        Liveness() : FunctionPass(ID) { }
+
+        virtual bool doInitialization (Module &M) {
+            namer.reset(new ValueNamer(&M));
+            return false;
+        }
+
+        virtual bool runOnFunction (Function &F) {
+            printLiveness(F, resultStream(), *namer);
+            return false;
+        }
+
+        private:
+        std::unique_ptr<ValueNamer> namer;
     };
 
     // register liveness analysis pass
     char Liveness::ID = 0;
     RegisterPass<Liveness> X("liveness", "Liveness Analysis");
-}
\ No newline at end of file
+}
+
+namespace llvm {
+    AnalysisKey LivenessAnalysis::Key;
+
+    LivenessInfo computeLiveness (Function &F) {
+        return computeLiveness(F, Engine);
+    }
+
+    LivenessInfo computeLiveness (Function &F, LivenessEngine engine) {
+        DataFlowResult result;
+        Domain domain;
+        // both engines give the same sets, so they share entries
+        CachedResult cached(F, "liveness");
+        if (cached.load(result, domain)) {
+            return LivenessInfo(domain, std::move(result));
+        }
+
+        domain = usedValues(F);
+        if (engine == SPARSE) {
+            PhaseTimer solveTimer("liveness", "solve", F);
+            result = sparseLiveness(F, domain);
+            solveTimer.stop();
+            cached.store(result, domain.size(), &domain);
+            return LivenessInfo(domain, std::move(result));
+        }
+
+        // initialize analysis
+        LivenessTransfer transfer(domain);
+        DataflowSolver<BACKWARD, UnionMeet, LivenessTransfer> analysis(transfer, WORKLIST, "liveness");
+        VSet boudary = transfer.emptySet(), interior = transfer.emptySet();
+        result = analysis.run(F, boudary, interior);
+        cached.store(result, domain.size(), &domain);
+
+        return LivenessInfo(domain, std::move(result));
+    }
+
+    LivenessInfo computeLiveness (Function &F, const CallSummaries &calls) {
+        Domain domain = usedValues(F);
+        LivenessTransfer transfer(domain, &calls);
+        DataflowSolver<BACKWARD, UnionMeet, LivenessTransfer> analysis(transfer, WORKLIST, "liveness");
+        DataFlowResult result = analysis.run(F, transfer.emptySet(), transfer.emptySet());
+        return LivenessInfo(domain, std::move(result), &calls);
+    }
+
+    void printLiveness (Function &F, raw_ostream &OS, ValueNamer &namer) {
+        computeLiveness(F).print(F, OS, namer);
+    }
+
+    // backward over one instruction, a PHI only kills, its operands are
+    // live on the incoming edges instead
+    void LivenessInfo::step (const Instruction &I, VSet &live) const {
+        if (!isa<PHINode>(I)) {
+            for (auto op = I.op_begin(); op != I.op_end(); ++op) {
+                Value *val = *op;
+                if (calls && !calls->reads(*op)) {
+                    continue;
+                }
+                // find live varaible
+                if (isa<Instruction>(val) || isa<Argument>(val)) {
+                    Index i = domain.find(val);
+                    if (i != Domain::NOT_FOUND) {
+                        live.set(i);
+                    }
+                }
+            }
+        }
+
+        // killed the redefined varaible
+        Index i = domain.find(&I);
+        if (i != Domain::NOT_FOUND) {
+            live.reset(i);
+        }
+    }
+
+    void LivenessInfo::print (Function &F, raw_ostream &OS, ValueNamer &namer) const {
+        ResultEmitter(OS, namer).emit(F, *this);
+    }
+}
@@ -0,0 +1,76 @@
+#include "Passes.h"
+
+namespace llvm {
+    void DataflowInfo::blockPoints (const BasicBlock *BB, std::vector<VSet> &facts) const {
+        // step through the whole block once, from whichever end is known
+        facts.resize(BB->size() + 1);
+        if (direction() == FORWARD) {
+            unsigned position = 0;
+            facts[0] = in(BB);
+            for (auto &inst : *BB) {
+                facts[position + 1] = facts[position];
+                step(inst, facts[position + 1]);
+                position++;
+            }
+        } else {
+            unsigned position = BB->size();
+            facts[position] = out(BB);
+            for (auto inst = BB->rbegin(); inst != BB->rend(); ++inst) {
+                --position;
+                facts[position] = facts[position + 1];
+                step(*inst, facts[position]);
+            }
+        }
+    }
+
+    // offset 0 is the point before I, 1 the point after it
+    const VSet &DataflowInfo::point (const Instruction *I, unsigned offset) const {
+        const BasicBlock *BB = I->getParent();
+        auto cached = points.find(BB);
+        if (cached == points.end()) {
+            auto block = std::make_shared<BlockPoints>();
+            unsigned position = 0;
+            for (auto &inst : *BB) {
+                block->position[&inst] = position++;
+            }
+            blockPoints(BB, block->facts);
+
+            cached = points.insert(std::make_pair(BB, std::move(block))).first;
+        }
+
+        const BlockPoints &block = *cached->second;
+        return block.facts[block.position.lookup(I) + offset];
+    }
+
+    const VSet &DataflowInfo::before (const Instruction *I) const {
+        return point(I, 0);
+    }
+
+    const VSet &DataflowInfo::after (const Instruction *I) const {
+        return point(I, 1);
+    }
+
+    BitVector DataflowInfo::holds (const Value *fact, ArrayRef<const Instruction*> at,
+        unsigned offset) const {
+        BitVector output(at.size());
+        Index i = factIndex(fact);
+        if (i == Domain::NOT_FOUND) {
+            return output;
+        }
+
+        for (unsigned p = 0; p < at.size(); ++p) {
+            if (point(at[p], offset).test(i)) {
+                output.set(p);
+            }
+        }
+        return output;
+    }
+
+    BitVector DataflowInfo::holdsBefore (const Value *fact, ArrayRef<const Instruction*> at) const {
+        return holds(fact, at, 0);
+    }
+
+    BitVector DataflowInfo::holdsAfter (const Value *fact, ArrayRef<const Instruction*> at) const {
+        return holds(fact, at, 1);
+    }
+}
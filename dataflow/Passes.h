@@ -0,0 +1,380 @@
+#ifndef DATAFLOW_PASSES_H
+#define DATAFLOW_PASSES_H
+
+#include "Dataflow.h"
+#include "Lattice.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/PassManager.h"
+
+#include <memory>
+
+namespace llvm {
+	// what a call does with its arguments, summarized from the body of the
+	// callee by the interprocedural mode of the module driver
+	struct CallSummary {
+		// arguments the callee reads, they are live on its entry
+		BitVector liveArgs;
+		// pointer arguments stored through on every path to a return
+		BitVector storedArgs;
+	};
+
+	// summaries of the defined functions of a module. A call through a
+	// pointer or to a function without one reads every argument and stores
+	// through none, which is what the analyses assume without summaries
+	class CallSummaries {
+		public:
+		// entries are added before any is read, solving only changes them
+		CallSummary &operator[] (const Function *F) { return summaries[F]; }
+		const CallSummary *lookup (const Function *F) const;
+
+		// U is read by its user, false for an argument the callee ignores
+		bool reads (const Use &U) const;
+		// pointers the call I has stored through once it returns
+		void stores (const Instruction &I, SmallVectorImpl<Value*> &pointers) const;
+
+		private:
+		DenseMap<const Function*, CallSummary> summaries;
+	};
+
+	// per-block result of an analysis over one function, owns its domain so
+	// it can be cached and queried after the solver is gone.
+	//
+	// Facts at a program point inside a block are found by stepping through
+	// the block from its in (forward) or out (backward) set. The first query
+	// into a block steps through all of it once and keeps every point, later
+	// queries are two hash lookups. The cache is not thread safe
+	class DataflowInfo {
+		public:
+		DataflowInfo () {}
+		DataflowInfo (Domain domain, DataFlowResult result, const CallSummaries *calls = nullptr)
+		: domain(std::move(domain)), result(std::move(result)), calls(calls)
+		{
+
+		};
+
+		const Domain &getDomain () const { return domain; }
+		const DataFlowResult &getResult () const { return result; }
+		const VSet &in (const BasicBlock *BB) const { return block(BB).in; }
+		const VSet &out (const BasicBlock *BB) const { return block(BB).out; }
+
+		// facts holding just before and just after I
+		const VSet &before (const Instruction *I) const;
+		const VSet &after (const Instruction *I) const;
+
+		// batched queries of one fact at many points, bit i of the result is
+		// set if it holds before (after) at[i]
+		BitVector holdsBefore (const Value *fact, ArrayRef<const Instruction*> at) const;
+		BitVector holdsAfter (const Value *fact, ArrayRef<const Instruction*> at) const;
+		// facts before every instruction of BB and after the last one, into
+		// facts (its sets are reused). Nothing is cached, for one pass over
+		// every block
+		void blockPoints (const BasicBlock *BB, std::vector<VSet> &facts) const;
+
+		protected:
+		const BlockResult &block (const BasicBlock *BB) const {
+			return result.at(BB);
+		}
+		bool contains (const VSet &set, const Value *fact) const {
+			Index i = factIndex(fact);
+			return i != Domain::NOT_FOUND && set.test(i);
+		}
+
+		// the domain index naming a fact
+		virtual Index factIndex (const Value *fact) const { return domain.find(fact); }
+		// the effect of one instruction, turns the fact before I into the one
+		// after it (forward) or the one after I into the one before (backward)
+		virtual Direction direction () const = 0;
+		virtual void step (const Instruction &I, VSet &fact) const = 0;
+
+		// results depend on every instruction, so only keep them if the pass
+		// preserved this analysis or everything
+		template<typename AnalysisT> static bool invalidated (const PreservedAnalyses &PA) {
+			auto PAC = PA.getChecker<AnalysisT>();
+			return !(PAC.preserved() || PAC.template preservedSet<AllAnalysesOn<Function>>());
+		}
+
+		Domain domain;
+		DataFlowResult result;
+		// the summaries calls were solved with, they outlive the result
+		const CallSummaries *calls = nullptr;
+
+		private:
+		// facts before every instruction of a block, then after the last one
+		struct BlockPoints {
+			std::vector<VSet> facts;
+			DenseMap<const Instruction*, unsigned> position;
+		};
+		const VSet &point (const Instruction *I, unsigned offset) const;
+		BitVector holds (const Value *fact, ArrayRef<const Instruction*> at, unsigned offset) const;
+
+		// shared between copies, the result they are built from never changes
+		mutable DenseMap<const BasicBlock*, std::shared_ptr<const BlockPoints>> points;
+	};
+
+	class LivenessAnalysis;
+	class ReachingAnalysis;
+	class AvailableAnalysis;
+	class ConstantAnalysis;
+
+	// values live at block boundaries
+	class LivenessInfo : public DataflowInfo {
+		public:
+		using DataflowInfo::DataflowInfo;
+
+		bool isLiveIn (const Value *V, const BasicBlock *BB) const { return contains(in(BB), V); }
+		bool isLiveOut (const Value *V, const BasicBlock *BB) const { return contains(out(BB), V); }
+		bool isLiveBefore (const Value *V, const Instruction *I) const { return contains(before(I), V); }
+		bool isLiveAfter (const Value *V, const Instruction *I) const { return contains(after(I), V); }
+
+		void print (Function &F, raw_ostream &OS, ValueNamer &namer) const;
+		bool invalidate (Function &, const PreservedAnalyses &PA,
+			FunctionAnalysisManager::Invalidator &) {
+			return invalidated<LivenessAnalysis>(PA);
+		}
+
+		protected:
+		Direction direction () const { return BACKWARD; }
+		void step (const Instruction &I, VSet &live) const;
+	};
+
+	// definitions (arguments and instructions) reaching block boundaries
+	class ReachingInfo : public DataflowInfo {
+		public:
+		using DataflowInfo::DataflowInfo;
+
+		bool reachesIn (const Value *def, const BasicBlock *BB) const { return contains(in(BB), def); }
+		bool reachesOut (const Value *def, const BasicBlock *BB) const { return contains(out(BB), def); }
+		bool reachesBefore (const Value *def, const Instruction *I) const { return contains(before(I), def); }
+		bool reachesAfter (const Value *def, const Instruction *I) const { return contains(after(I), def); }
+
+		void print (Function &F, raw_ostream &OS, ValueNamer &namer) const;
+		bool invalidate (Function &, const PreservedAnalyses &PA,
+			FunctionAnalysisManager::Invalidator &) {
+			return invalidated<ReachingAnalysis>(PA);
+		}
+
+		protected:
+		Direction direction () const { return FORWARD; }
+		void step (const Instruction &I, VSet &reaching) const;
+	};
+
+	// expressions available at block boundaries, an expression is named by
+	// any BinaryOperator computing it
+	class AvailableInfo : public DataflowInfo {
+		public:
+		AvailableInfo () {}
+		AvailableInfo (ExpressionTable table, DataFlowResult result)
+		: DataflowInfo(table.domain(), std::move(result)), table(std::move(table))
+		{
+
+		};
+
+		bool isAvailableIn (const Instruction *expr, const BasicBlock *BB) const {
+			return contains(in(BB), expr);
+		}
+		bool isAvailableOut (const Instruction *expr, const BasicBlock *BB) const {
+			return contains(out(BB), expr);
+		}
+		bool isAvailableBefore (const Instruction *expr, const Instruction *I) const {
+			return contains(before(I), expr);
+		}
+		bool isAvailableAfter (const Instruction *expr, const Instruction *I) const {
+			return contains(after(I), expr);
+		}
+		const ExpressionTable &getExpressions () const { return table; }
+
+		void print (Function &F, raw_ostream &OS, ValueNamer &namer) const;
+		bool invalidate (Function &, const PreservedAnalyses &PA,
+			FunctionAnalysisManager::Invalidator &) {
+			return invalidated<AvailableAnalysis>(PA);
+		}
+
+		protected:
+		// any instruction computing the expression names it
+		Index factIndex (const Value *fact) const {
+			auto expr = dyn_cast<Instruction>(fact);
+			return expr ? table.find(expr) : Domain::NOT_FOUND;
+		}
+		Direction direction () const { return FORWARD; }
+		void step (const Instruction &I, VSet &available) const;
+
+		private:
+		ExpressionTable table;
+	};
+
+	// what constant propagation knows about a value, a tag of one byte:
+	// undefined (its definition has not run yet), constant or overdefined
+	// (not a constant). Which constant it is sits next to it in ConstantInfo.
+	// The join is an or
+	class ConstantValue {
+		public:
+		ConstantValue () : tag(UNDEFINED) {}
+
+		static ConstantValue bottom () { return ConstantValue(); }
+		static ConstantValue constant () { return ConstantValue(CONSTANT); }
+		static ConstantValue overdefined () { return ConstantValue(OVERDEFINED); }
+
+		bool isUndefined () const { return tag == UNDEFINED; }
+		bool isConstant () const { return tag == CONSTANT; }
+		bool isOverdefined () const { return tag == OVERDEFINED; }
+
+		static ConstantValue join (ConstantValue a, ConstantValue b) { return ConstantValue(a.tag | b.tag); }
+		static bool leq (ConstantValue a, ConstantValue b) { return (a.tag | b.tag) == b.tag; }
+		// the lattice is two steps high, a join already stops
+		static ConstantValue widen (ConstantValue old, ConstantValue next) { return join(old, next); }
+
+		bool operator== (ConstantValue other) const { return tag == other.tag; }
+		bool operator!= (ConstantValue other) const { return tag != other.tag; }
+
+		private:
+		enum Tag : uint8_t {
+			UNDEFINED = 0,
+			CONSTANT = 1,
+			OVERDEFINED = 3
+		};
+		explicit ConstantValue (uint8_t tag) : tag(tag) {}
+		uint8_t tag;
+	};
+
+	// one cell per domain entry
+	typedef LatticeVector<ConstantValue> ConstantLattice;
+
+	// constants of the integer and floating point SSA values of a function.
+	// Every value has one definition, so it has one cell for the whole
+	// function, solved sparsely along def-use chains and the edges that can
+	// run
+	class ConstantInfo {
+		public:
+		ConstantInfo () {}
+		ConstantInfo (Domain domain, ConstantLattice values, std::vector<Constant*> constants,
+			DenseSet<const BasicBlock*> executable)
+		: domain(std::move(domain)), values(std::move(values)), constants(std::move(constants)),
+		executable(std::move(executable))
+		{
+
+		};
+
+		const Domain &getDomain () const { return domain; }
+		const ConstantLattice &getValues () const { return values; }
+		// BB is reached along edges whose branch conditions can hold
+		bool isExecutable (const BasicBlock *BB) const { return executable.count(BB); }
+
+		// what V is, undefined for values outside the domain and for code
+		// never reached
+		ConstantValue valueOf (const Value *V) const;
+		// the constant V always is, null if there is none
+		Constant *getConstant (const Value *V) const;
+		// the constant of domain entry i, where its value is a constant
+		Constant *constant (Index i) const { return constants[i]; }
+
+		void print (Function &F, raw_ostream &OS, ValueNamer &namer) const;
+		bool invalidate (Function &, const PreservedAnalyses &PA,
+			FunctionAnalysisManager::Invalidator &) {
+			auto PAC = PA.getChecker<ConstantAnalysis>();
+			return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>());
+		}
+
+		private:
+		Domain domain;
+		ConstantLattice values;
+		std::vector<Constant*> constants;
+		DenseSet<const BasicBlock*> executable;
+	};
+
+	// liveness engines, the generic bit-set solver or a sparse walk from each
+	// use back to its definition, both give the same block sets
+	enum LivenessEngine {
+		ITERATIVE,
+		SPARSE
+	};
+
+	// solve an analysis over F, liveness uses the -liveness-engine one
+	LivenessInfo computeLiveness (Function &F);
+	LivenessInfo computeLiveness (Function &F, LivenessEngine engine);
+	ReachingInfo computeReaching (Function &F);
+	AvailableInfo computeAvailable (Function &F);
+	ConstantInfo computeConstants (Function &F);
+
+	// liveness and reaching where calls apply the summaries of their callees,
+	// calls has to outlive the result
+	LivenessInfo computeLiveness (Function &F, const CallSummaries &calls);
+	ReachingInfo computeReaching (Function &F, const CallSummaries &calls);
+
+	// solve every defined function of M bottom-up over the SCCs of its call
+	// graph, so each one sees the final summaries of its callees. SCCs that
+	// do not call each other are solved in parallel on threads workers. A
+	// recursive SCC is solved again until its summaries stop changing, at
+	// most -dataflow-summary-rounds times before they give up and become
+	// what an unknown callee does. done gets every function once with its
+	// final result, from the worker that solved it
+	void summarizeLiveness (Module &M, CallSummaries &calls, unsigned threads,
+		function_ref<void (Function &, const LivenessInfo &)> done);
+	void summarizeReaching (Module &M, CallSummaries &calls, unsigned threads,
+		function_ref<void (Function &, const ReachingInfo &)> done);
+
+	// new pass manager analyses, results are cached in the FunctionAnalysisManager
+	class LivenessAnalysis : public AnalysisInfoMixin<LivenessAnalysis> {
+		public:
+		typedef LivenessInfo Result;
+		Result run (Function &F, FunctionAnalysisManager &) { return computeLiveness(F); }
+
+		private:
+		friend AnalysisInfoMixin<LivenessAnalysis>;
+		static AnalysisKey Key;
+	};
+
+	class ReachingAnalysis : public AnalysisInfoMixin<ReachingAnalysis> {
+		public:
+		typedef ReachingInfo Result;
+		Result run (Function &F, FunctionAnalysisManager &) { return computeReaching(F); }
+
+		private:
+		friend AnalysisInfoMixin<ReachingAnalysis>;
+		static AnalysisKey Key;
+	};
+
+	class AvailableAnalysis : public AnalysisInfoMixin<AvailableAnalysis> {
+		public:
+		typedef AvailableInfo Result;
+		Result run (Function &F, FunctionAnalysisManager &) { return computeAvailable(F); }
+
+		private:
+		friend AnalysisInfoMixin<AvailableAnalysis>;
+		static AnalysisKey Key;
+	};
+
+	class ConstantAnalysis : public AnalysisInfoMixin<ConstantAnalysis> {
+		public:
+		typedef ConstantInfo Result;
+		Result run (Function &F, FunctionAnalysisManager &) { return computeConstants(F); }
+
+		private:
+		friend AnalysisInfoMixin<ConstantAnalysis>;
+		static AnalysisKey Key;
+	};
+
+	// print<liveness>, print<reaching>, print<available> and print<constants>,
+	// same output as the legacy passes but taken from the cached result
+	template<typename AnalysisT> class DataflowPrinterPass
+		: public PassInfoMixin<DataflowPrinterPass<AnalysisT>> {
+		public:
+		DataflowPrinterPass (raw_ostream &OS) : OS(OS) {}
+
+		PreservedAnalyses run (Function &F, FunctionAnalysisManager &FAM) {
+			ValueNamer namer(F.getParent());
+			FAM.getResult<AnalysisT>(F).print(F, OS, namer);
+			return PreservedAnalyses::all();
+		}
+
+		private:
+		raw_ostream &OS;
+	};
+
+	typedef DataflowPrinterPass<LivenessAnalysis> LivenessPrinterPass;
+	typedef DataflowPrinterPass<ReachingAnalysis> ReachingPrinterPass;
+	typedef DataflowPrinterPass<AvailableAnalysis> AvailablePrinterPass;
+	typedef DataflowPrinterPass<ConstantAnalysis> ConstantPrinterPass;
+};
+
+#endif
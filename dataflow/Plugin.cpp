@@ -0,0 +1,50 @@
+#include "Emitter.h"
+
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+namespace {
+    // print<name>, require<name> and invalidate<name> for one analysis
+    template<typename AnalysisT, typename PrinterT>
+    bool parsePass (StringRef Name, StringRef analysis, FunctionPassManager &FPM) {
+        if (Name == ("print<" + analysis + ">").str()) {
+            FPM.addPass(PrinterT(resultStream()));
+            return true;
+        }
+        if (Name == ("require<" + analysis + ">").str()) {
+            FPM.addPass(RequireAnalysisPass<AnalysisT, Function>());
+            return true;
+        }
+        if (Name == ("invalidate<" + analysis + ">").str()) {
+            FPM.addPass(InvalidateAnalysisPass<AnalysisT>());
+            return true;
+        }
+        return false;
+    }
+
+    void registerPasses (PassBuilder &PB) {
+        PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM) {
+            FAM.registerPass([] { return LivenessAnalysis(); });
+            FAM.registerPass([] { return ReachingAnalysis(); });
+            FAM.registerPass([] { return AvailableAnalysis(); });
+            FAM.registerPass([] { return ConstantAnalysis(); });
+        });
+
+        PB.registerPipelineParsingCallback([](StringRef Name, FunctionPassManager &FPM,
+            ArrayRef<PassBuilder::PipelineElement>) {
+            if (Name == "print<constants>" && !canEmitConstants(Name)) {
+                return false;
+            }
+            return parsePass<LivenessAnalysis, LivenessPrinterPass>(Name, "liveness", FPM)
+                || parsePass<ReachingAnalysis, ReachingPrinterPass>(Name, "reaching", FPM)
+                || parsePass<AvailableAnalysis, AvailablePrinterPass>(Name, "available", FPM)
+                || parsePass<ConstantAnalysis, ConstantPrinterPass>(Name, "constants", FPM);
+        });
+    }
+}
+
+// new pass manager entry point, opt -load-pass-plugin libDataFlow.so -passes='print<liveness>'
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo () {
+    return {LLVM_PLUGIN_API_VERSION, "DataFlow", LLVM_VERSION_STRING, registerPasses};
+}
@@ -1,118 +1,177 @@
-#include "Dataflow.h"
+#include "Cache.h"
+#include "Emitter.h"
+#include "Solver.h"
 
 using namespace llvm;
 namespace {
-    class Reaching : public FunctionPass {
+    class ReachingTransfer : public GenKillTransfer<ReachingTransfer> {
         public:
-        static char ID;
+        ReachingTransfer (const Domain &domain, const CallSummaries *calls = nullptr)
+        : GenKillTransfer(domain), calls(calls) {}
 
-        virtual void getAnalysisUsage (AnalysisUsage& AU) const {
-            AU.setPreservesAll();
-        }
+        BlockSummary summarize (BasicBlock *curr) {
+            BlockSummary output;
+            VSet &gen = output.gen, &kill = output.kill;
 
-        Reaching() : FunctionPass(ID) {}
+            gen = emptySet();
+            kill = emptySet();
+            for (auto inst = curr->begin(); inst != curr->end(); ++inst) {
+                // a store redefines its pointer, anything else itself
+                Value *val = &*inst;
+                if (auto load_ins = dyn_cast<StoreInst>(&*inst)) {
+                    val = load_ins->getPointerOperand();
+                }
 
-        virtual bool runOnFunction(Function &F) {
-            outs() << "Function: " << F.getName() << "\n";
-            DataFlowResult result;
-            Domain domain;
-
-            VSet boudary, interior;
-            // use functions arguments to initialize
-            for (auto arg = F.arg_begin(); arg != F.arg_end(); ++arg) {
-                domain.push_back(&*arg);
-                boudary.insert(domain.size() - 1);
-            }
-            
-            // add remaining instruction
-            for (auto I = inst_begin(F); I != inst_end(F); ++I) {
-                if (Value* val = dyn_cast<Value> (&*I)) {
-                    if (getValueName(val) != "") {
-                        if (std::find(domain.begin(), domain.end(), val) == domain.end()) {
-                            domain.push_back(val);
-                        }
-                    }
+                // if it has be re-assigned, kill it
+                Index killed = domainIndex(val);
+                if (killed != INDEX_NOT_FOUND) {
+                    kill.set(killed);
+
+                    // some values are killed in the same Basic Block, so sad
+                    gen.reset(killed);
                 }
-            }
 
-            Analysis analysis  = Analysis(Direction::FORWARD, MeetOp::UNION, domain);
-            result = analysis.run(F, boudary, interior);
-            // output in/out
-            for (auto &BB : F) {
-                outs () << "\n<" << BB.getName() << ">\n";
-                outs () << "in: ";
-                for (auto i : result.result[&BB].in) {
-                    outs() << getValueName((Value *)analysis.domain[i]) << " ";
+                Index i = domainIndex(&*inst);
+                if (i != INDEX_NOT_FOUND) {
+                    gen.set(i);
+                }
+
+                // a call storing through a pointer redefines it like a store
+                if (calls) {
+                    stored.clear();
+                    calls->stores(*inst, stored);
+                    for (auto ptr : stored) {
+                        Index k = domainIndex(ptr);
+                        if (k != INDEX_NOT_FOUND) {
+                            kill.set(k);
+                            gen.reset(k);
+                        }
+                    }
                 }
-                outs () <<"\nout: ";
-                for (auto i : result.result[&BB].out) {
-                    outs() << getValueName((Value *)analysis.domain[i]) << " ";
-                }            
-                outs () << "\n";    
             }
 
-            return false;
+            return output;
         }
 
         private:
-        class Analysis : public Dataflow {
-            public:
-            Analysis (Direction direction, MeetOp meetop, Domain domain)
-                : Dataflow (direction, meetop, domain) {}
-            
-            TransferOutput transferFn (VSet input, BasicBlock *curr) {
-                TransferOutput output;
-                VSet gen, kill;
-                for (auto inst = curr->begin(); inst != curr->end(); ++inst) {
-                    std::string val = "";
-                    if (isa<Instruction> (&*inst)) {
-                        val = getValueName(&*inst);
-                    }
+        const CallSummaries *calls;
+        SmallVector<Value*, 4> stored;
+    };
 
-                    if (auto load_ins = dyn_cast<StoreInst>(&*inst)) {
-                        val = getValueName(load_ins->getPointerOperand());
-                    }
+    // arguments first, then every instruction defining a value
+    Domain definitions (Function &F) {
+        Domain domain;
+        PhaseTimer domainTimer("reaching", "domain", F);
 
-                    if (val == "") {
-                        continue;
-                    }
+        // use functions arguments to initialize
+        for (auto arg = F.arg_begin(); arg != F.arg_end(); ++arg) {
+            domain.insert(&*arg);
+        }
 
-                    // if input has be re-assigned, kill it
-                    for (auto LHS : input) {
-                        if (isa<Instruction> (&*inst)) {
-                            if (getValueName((Value *) domain[LHS]) == val) {
-                                kill.insert(LHS);
-                            }
-                        }      
-                    }
+        // add remaining instruction, only the ones defining a value have a name
+        for (auto I = inst_begin(F); I != inst_end(F); ++I) {
+            if (!I->getType()->isVoidTy()) {
+                domain.insert(&*I);
+            }
+        }
 
-                    // some values are killed in the same Basic Block, so sad
-                    auto tmp = gen.end();
-                    for (auto i = gen.begin(); i != gen.end(); ++i) {
-                        if (tmp != gen.end()) {
-                            gen.erase(tmp);
-                            tmp = gen.end();
-                        }
-                        if (getValueName((Value *) domain[*i]) == val) {
-                            tmp = i;
-                        }
-                    }
+        return domain;
+    }
 
-                    Index i = domainIndex(&*inst);
-                    if (i != INDEX_NOT_FOUND) {
-                        gen.insert(i);
-                    }
-                }
+    class Reaching : public FunctionPass {
+        public:
+        static char ID;
 
-                // (input - kill) U gen  
-                VSet tmp = substractSet(input, kill);
-                output.transfer = unionSet(tmp, gen);
-                return output;
-            }
-        };
+        virtual void getAnalysisUsage (AnalysisUsage& AU) const {
+            AU.setPreservesAll();
+        }
+
+        Reaching() : FunctionPass(ID) {}
+
+        virtual bool doInitialization (Module &M) {
+            namer.reset(new ValueNamer(&M));
+            return false;
+        }
+
+        virtual bool runOnFunction(Function &F) {
+            printReaching(F, resultStream(), *namer);
+            return false;
+        }
+
+        private:
+        std::unique_ptr<ValueNamer> namer;
     };
 
     // register pass
     char Reaching::ID = 0;
     RegisterPass<Reaching> X("reaching", "Reaching Definition");
-}
\ No newline at end of file
+}
+
+namespace llvm {
+    AnalysisKey ReachingAnalysis::Key;
+
+    ReachingInfo computeReaching (Function &F) {
+        DataFlowResult result;
+        Domain domain;
+        CachedResult cached(F, "reaching");
+        if (cached.load(result, domain)) {
+            return ReachingInfo(domain, std::move(result));
+        }
+        domain = definitions(F);
+        // every argument reaches the entry
+        VSet boudary(F.arg_size(), true);
+
+        ReachingTransfer transfer(domain);
+        DataflowSolver<FORWARD, UnionMeet, ReachingTransfer> analysis(transfer, WORKLIST, "reaching");
+        VSet interior = transfer.emptySet();
+        result = analysis.run(F, boudary, interior);
+        cached.store(result, domain.size(), &domain);
+
+        return ReachingInfo(domain, std::move(result));
+    }
+
+    ReachingInfo computeReaching (Function &F, const CallSummaries &calls) {
+        Domain domain = definitions(F);
+        ReachingTransfer transfer(domain, &calls);
+        DataflowSolver<FORWARD, UnionMeet, ReachingTransfer> analysis(transfer, WORKLIST, "reaching");
+        DataFlowResult result = analysis.run(F, VSet(F.arg_size(), true), transfer.emptySet());
+        return ReachingInfo(domain, std::move(result), &calls);
+    }
+
+    void printReaching (Function &F, raw_ostream &OS, ValueNamer &namer) {
+        computeReaching(F).print(F, OS, namer);
+    }
+
+    // forward over one instruction, same as the block summary
+    void ReachingInfo::step (const Instruction &I, VSet &reaching) const {
+        const Value *val = &I;
+        if (auto store = dyn_cast<StoreInst>(&I)) {
+            val = store->getPointerOperand();
+        }
+
+        Index killed = domain.find(val);
+        if (killed != Domain::NOT_FOUND) {
+            reaching.reset(killed);
+        }
+
+        Index i = domain.find(&I);
+        if (i != Domain::NOT_FOUND) {
+            reaching.set(i);
+        }
+
+        if (calls) {
+            SmallVector<Value*, 4> stored;
+            calls->stores(I, stored);
+            for (auto ptr : stored) {
+                Index k = domain.find(ptr);
+                if (k != Domain::NOT_FOUND) {
+                    reaching.reset(k);
+                }
+            }
+        }
+    }
+
+    void ReachingInfo::print (Function &F, raw_ostream &OS, ValueNamer &namer) const {
+        ResultEmitter(OS, namer).emit(F, *this);
+    }
+}
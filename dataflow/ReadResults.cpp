@@ -0,0 +1,129 @@
+#include "ResultFile.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+
+#include <chrono>
+
+using namespace llvm;
+namespace {
+    static cl::opt<std::string> Input(cl::Positional, cl::Required,
+        cl::desc("<-dataflow-format=binary results>"));
+
+    static cl::opt<bool> Print("print",
+        cl::desc("Print the in and out set of every block by name"),
+        cl::init(false));
+
+    static cl::opt<std::string> Text("text",
+        cl::desc("Text dump of the same results, its size and load time are reported next to the binary"),
+        cl::value_desc("file"), cl::init(""));
+
+    const char *analysisName (results::RecordKind kind) {
+        switch (kind) {
+            case results::LIVENESS_RECORD:
+                return "liveness";
+            case results::REACHING_RECORD:
+                return "reaching";
+            case results::AVAILABLE_RECORD:
+                return "available";
+            default:
+                return "file";
+        }
+    }
+
+    void printSet (const ResultRecord &record, const BitVector &set) {
+        for (auto i : set.set_bits()) {
+            outs() << record.valueName(i) << " ";
+        }
+    }
+
+    double since (std::chrono::steady_clock::time_point start) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+}
+
+// dataflow-read: load a binary result file without LLVM IR, print it or
+// report its size and load time against a text dump of the same results
+int main (int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "dataflow binary result reader\n");
+
+    auto start = std::chrono::steady_clock::now();
+    auto file = ResultFile::open(Input);
+    if (!file) {
+        logAllUnhandledErrors(file.takeError(), errs(), StringRef(argv[0]) + ": ");
+        return 1;
+    }
+    double open = since(start);
+
+    // every set decoded once, what a client walking all results pays
+    start = std::chrono::steady_clock::now();
+    uint64_t functions = 0, blocks = 0, values = 0, facts = 0;
+    BitVector in, out;
+    for (auto &record : (*file)->records()) {
+        if (Print) {
+            if (record.isFile()) {
+                outs() << "File: " << record.name() << "\n";
+            } else {
+                outs() << "Function: " << record.name() << " (" << analysisName(record.kind()) << ")\n";
+            }
+        }
+        if (record.isFile()) {
+            continue;
+        }
+
+        functions++;
+        values += record.domain();
+        for (unsigned b = 0; b < record.blocks(); ++b) {
+            record.in(b, in);
+            record.out(b, out);
+            facts += in.count() + out.count();
+            if (Print) {
+                outs() << "\n<" << record.blockName(b) << ">\nin: ";
+                printSet(record, in);
+                outs() << "\nout: ";
+                printSet(record, out);
+                outs() << "\n";
+            }
+        }
+        blocks += record.blocks();
+        if (Print) {
+            outs() << "\n";
+        }
+    }
+    double decode = since(start);
+    if (Print) {
+        return 0;
+    }
+
+    outs() << "functions\tblocks\tvalues\tfacts\n"
+        << functions << "\t" << blocks << "\t" << values << "\t" << facts << "\n\n";
+    outs() << "format\tbytes\tload(s)\n";
+    outs() << "binary\t" << (*file)->bytes() << "\t" << format("%.6f", open + decode) << "\n";
+
+    if (!Text.empty()) {
+        // the cheapest load of a text dump: read it and split every line
+        // into the names it lists
+        start = std::chrono::steady_clock::now();
+        auto text = MemoryBuffer::getFileOrSTDIN(Text);
+        if (!text) {
+            errs() << argv[0] << ": " << Text << ": " << text.getError().message() << "\n";
+            return 1;
+        }
+        uint64_t names = 0;
+        SmallVector<StringRef, 64> fields;
+        for (line_iterator line(**text); !line.is_at_end(); ++line) {
+            fields.clear();
+            line->split(fields, ' ', -1, false);
+            names += fields.size();
+        }
+        double load = since(start);
+        outs() << "text\t" << (*text)->getBufferSize() << "\t" << format("%.6f", load) << "\n";
+        outs() << "ratio\t" << format("%.2fx", (double) (*text)->getBufferSize() / (*file)->bytes())
+            << "\t" << format("%.2fx", load / (open + decode)) << "\n";
+    }
+    return 0;
+}
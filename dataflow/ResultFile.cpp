@@ -0,0 +1,298 @@
+#include "ResultFile.h"
+
+#include "llvm/Support/LEB128.h"
+
+using namespace llvm::results;
+
+namespace llvm {
+    namespace {
+        const char Magic[4] = {'D', 'F', 'R', 'S'};
+
+        void align (SmallVectorImpl<char> &bytes) {
+            bytes.resize(alignTo(bytes.size(), 4), 0);
+        }
+
+        template<typename T> void append (SmallVectorImpl<char> &bytes, const T &value) {
+            const char *raw = reinterpret_cast<const char *>(&value);
+            bytes.append(raw, raw + sizeof(T));
+        }
+
+        template<typename T> void append (SmallVectorImpl<char> &bytes, ArrayRef<T> values) {
+            const char *raw = reinterpret_cast<const char *>(values.data());
+            bytes.append(raw, raw + values.size() * sizeof(T));
+        }
+
+        void uleb (SmallVectorImpl<char> &bytes, uint64_t value) {
+            uint8_t buf[16];
+            unsigned n = encodeULEB128(value, buf);
+            bytes.append(buf, buf + n);
+        }
+
+        // the runs at p into set, or only checked if set is null. False if
+        // they do not fit size bits or run past end
+        bool decodeRuns (const uint8_t *p, const uint8_t *end, uint64_t size, BitVector *set) {
+            const char *error = nullptr;
+            unsigned n;
+            uint64_t count = decodeULEB128(p, &n, end, &error);
+            p += n;
+            uint64_t pos = 0;
+            for (uint64_t r = 0; r < count && !error; ++r) {
+                uint64_t zeros = decodeULEB128(p, &n, end, &error);
+                p += n;
+                if (error || zeros > size - pos) {
+                    return false;
+                }
+                pos += zeros;
+                uint64_t ones = decodeULEB128(p, &n, end, &error);
+                p += n;
+                if (error || ones > size - pos) {
+                    return false;
+                }
+                if (set) {
+                    set->set(pos, pos + ones);
+                }
+                pos += ones;
+            }
+            return !error;
+        }
+    }
+
+    RecordWriter::RecordWriter (RecordKind kind, StringRef function, unsigned transfers)
+    : kind(kind), transfers(transfers)
+    {
+        name = string(function);
+    }
+
+    unsigned RecordWriter::string (StringRef str) {
+        unsigned offset = strings.size();
+        strings.append(str.begin(), str.end());
+        strings.push_back(0);
+        return offset;
+    }
+
+    void RecordWriter::value (unsigned id, StringRef name) {
+        DomainEntry entry;
+        entry.id = id;
+        entry.name = string(name);
+        entries.push_back(entry);
+    }
+
+    // the number of runs, then the length of every run of zeros and the run
+    // of ones after it. Trailing zeros are left out
+    void RecordWriter::runs (const BitVector &set) {
+        SmallVector<uint64_t, 32> lengths;
+        int pos = 0;
+        for (int start = set.find_first(); start != -1; ) {
+            int end = set.find_next_unset(start);
+            if (end == -1) {
+                end = set.size();
+            }
+            lengths.push_back(start - pos);
+            lengths.push_back(end - start);
+            pos = end;
+            start = end < (int) set.size() ? set.find_next(end - 1) : -1;
+        }
+
+        uleb(sets, lengths.size() / 2);
+        for (auto length : lengths) {
+            uleb(sets, length);
+        }
+    }
+
+    void RecordWriter::block (StringRef name, const BitVector &in, const BitVector &out) {
+        BlockEntry entry;
+        entry.name = string(name);
+        entry.in = sets.size();
+        runs(in);
+
+        entry.out = sets.size();
+        delta = in;
+        delta.resize(out.size());
+        delta ^= out;
+        runs(delta);
+        blocks.push_back(entry);
+    }
+
+    void RecordWriter::write (raw_ostream &OS) {
+        // offsets written so far are inside the sets and strings, move them
+        // to the record start
+        unsigned entriesStart = sizeof(RecordHeader) + sizeof(FunctionHeader);
+        unsigned blockTable = entriesStart + entries.size() * sizeof(DomainEntry);
+        unsigned setsStart = blockTable + blocks.size() * sizeof(BlockEntry);
+        unsigned stringsStart = alignTo(setsStart + sets.size(), 4);
+        for (auto &entry : entries) {
+            entry.name = entry.name + stringsStart;
+        }
+        for (auto &block : blocks) {
+            block.name = block.name + stringsStart;
+            block.in = block.in + setsStart;
+            block.out = block.out + setsStart;
+        }
+
+        RecordHeader header;
+        memcpy(header.magic, Magic, 4);
+        header.version = Version;
+        header.kind = kind;
+        header.size = alignTo(stringsStart + strings.size(), 4);
+
+        FunctionHeader function;
+        function.name = stringsStart + name;
+        function.blocks = blocks.size();
+        function.domain = entries.size();
+        function.transfers = transfers;
+        function.entries = entriesStart;
+        function.blockTable = blockTable;
+        function.sets = setsStart;
+        function.strings = stringsStart;
+
+        SmallVector<char, 4096> record;
+        record.reserve(header.size);
+        append(record, header);
+        append(record, function);
+        append(record, ArrayRef<DomainEntry>(entries));
+        append(record, ArrayRef<BlockEntry>(blocks));
+        record.append(sets.begin(), sets.end());
+        align(record);
+        record.append(strings.begin(), strings.end());
+        align(record);
+        OS.write(record.data(), record.size());
+    }
+
+    void RecordWriter::writeFile (raw_ostream &OS, StringRef path) {
+        SmallVector<char, 256> record;
+        record.resize(sizeof(RecordHeader));
+        record.append(path.begin(), path.end());
+        record.push_back(0);
+        align(record);
+
+        auto header = reinterpret_cast<RecordHeader *>(record.data());
+        memcpy(header->magic, Magic, 4);
+        header->version = Version;
+        header->kind = FILE_RECORD;
+        header->size = record.size();
+        OS.write(record.data(), record.size());
+    }
+
+    StringRef ResultRecord::string (unsigned offset) const {
+        return StringRef(base() + offset);
+    }
+
+    StringRef ResultRecord::name () const {
+        if (isFile()) {
+            return StringRef(base() + sizeof(RecordHeader));
+        }
+        return string(function()->name);
+    }
+
+    void ResultRecord::in (unsigned b, BitVector &set) const {
+        set.clear();
+        set.resize(domain());
+        auto start = reinterpret_cast<const uint8_t *>(base());
+        bool valid = decodeRuns(start + blockTable()[b].in, start + function()->strings, domain(), &set);
+        assert(valid && "runs of a record that was not checked");
+        (void) valid;
+    }
+
+    // in, then the runs of in XOR out flipped a word at a time
+    void ResultRecord::out (unsigned b, BitVector &set) const {
+        in(b, set);
+        BitVector delta(domain());
+        auto start = reinterpret_cast<const uint8_t *>(base());
+        bool valid = decodeRuns(start + blockTable()[b].out, start + function()->strings, domain(), &delta);
+        assert(valid && "runs of a record that was not checked");
+        (void) valid;
+        set ^= delta;
+    }
+
+    Error ResultRecord::check () const {
+        auto corrupt = [&](const char *what) {
+            return createStringError(inconvertibleErrorCode(), "%s in a record of %u bytes",
+                what, (unsigned) size());
+        };
+
+        // strings end in a NUL before the end of the record
+        auto terminated = [&](size_t from) {
+            return from < size() && memchr(base() + from, 0, size() - from);
+        };
+        if (isFile()) {
+            return terminated(sizeof(RecordHeader)) ? Error::success() : corrupt("unterminated file name");
+        }
+        if (kind() > AVAILABLE_RECORD) {
+            return corrupt("unknown record kind");
+        }
+        if (size() < sizeof(RecordHeader) + sizeof(FunctionHeader)) {
+            return corrupt("truncated function header");
+        }
+
+        const FunctionHeader *f = function();
+        uint64_t entriesEnd = f->entries + (uint64_t) f->domain * sizeof(DomainEntry);
+        uint64_t blocksEnd = f->blockTable + (uint64_t) f->blocks * sizeof(BlockEntry);
+        if (f->entries % 4 || f->blockTable % 4 || entriesEnd > f->blockTable
+            || blocksEnd > f->sets || f->sets > f->strings || f->strings > size()) {
+            return corrupt("tables out of order");
+        }
+        if (!terminated(f->name)) {
+            return corrupt("bad function name");
+        }
+        for (unsigned i = 0; i < f->domain; ++i) {
+            if (!terminated(entries()[i].name)) {
+                return corrupt("bad value name");
+            }
+        }
+        for (unsigned b = 0; b < f->blocks; ++b) {
+            const BlockEntry &block = blockTable()[b];
+            if (!terminated(block.name) || block.in < f->sets || block.in >= f->strings
+                || block.out < f->sets || block.out >= f->strings) {
+                return corrupt("bad block entry");
+            }
+            auto start = reinterpret_cast<const uint8_t *>(base());
+            if (!decodeRuns(start + block.in, start + f->strings, f->domain, nullptr)
+                || !decodeRuns(start + block.out, start + f->strings, f->domain, nullptr)) {
+                return corrupt("bad set");
+            }
+        }
+        return Error::success();
+    }
+
+    Expected<std::unique_ptr<ResultFile>> ResultFile::open (StringRef path) {
+        // mapped, not read, the records are used in place
+        auto buffer = MemoryBuffer::getFileOrSTDIN(path, false, false);
+        if (!buffer) {
+            return createFileError(path, buffer.getError());
+        }
+
+        std::unique_ptr<ResultFile> file(new ResultFile(std::move(*buffer)));
+        StringRef data = file->buffer->getBuffer();
+        size_t offset = 0;
+        while (offset < data.size()) {
+            if (data.size() - offset < sizeof(RecordHeader)) {
+                return createFileError(path, createStringError(inconvertibleErrorCode(),
+                    "truncated record at offset %zu", offset));
+            }
+
+            auto header = reinterpret_cast<const RecordHeader *>(data.data() + offset);
+            if (memcmp(header->magic, Magic, 4) != 0) {
+                return createFileError(path, createStringError(inconvertibleErrorCode(),
+                    "no dataflow record at offset %zu", offset));
+            }
+            if (header->version > Version) {
+                return createFileError(path, createStringError(inconvertibleErrorCode(),
+                    "record version %u at offset %zu is newer than %u",
+                    (unsigned) header->version, offset, Version));
+            }
+            if (header->size < sizeof(RecordHeader) || header->size % 4
+                || header->size > data.size() - offset) {
+                return createFileError(path, createStringError(inconvertibleErrorCode(),
+                    "bad record size at offset %zu", offset));
+            }
+
+            ResultRecord record(header);
+            if (Error E = record.check()) {
+                return createFileError(path, std::move(E));
+            }
+            file->all.push_back(record);
+            offset += header->size;
+        }
+        return file;
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef DATAFLOW_RESULTFILE_H
+#define DATAFLOW_RESULTFILE_H
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+
+namespace llvm {
+	// results in binary, -dataflow-format=binary. A file is a sequence of
+	// records, one per analyzed function plus one naming each input file of
+	// dataflow-batch, so dumps of many functions and processes concatenate.
+	// Everything is little endian and 4-byte aligned, a reader maps the file
+	// and reads the tables in place, sets are decoded only when asked for.
+	//
+	// A function record holds the domain as stable value IDs (the position
+	// of the value among the arguments and then the instructions of the
+	// function, for an expression the first instruction computing it) with
+	// their printed names, every block's name and its in and out set. Sets
+	// are run lengths, out as the runs of in XOR out, which is mostly empty
+	namespace results {
+		typedef support::ulittle16_t u16;
+		typedef support::ulittle32_t u32;
+
+		// readers refuse records of a newer version
+		const unsigned Version = 1;
+
+		enum RecordKind {
+			FILE_RECORD,
+			LIVENESS_RECORD,
+			REACHING_RECORD,
+			AVAILABLE_RECORD
+		};
+
+		struct RecordHeader {
+			char magic[4];
+			u16 version, kind;
+			// bytes of the whole record, header included
+			u32 size;
+		};
+
+		// offsets are from the start of the record
+		struct FunctionHeader {
+			u32 name, blocks, domain, transfers;
+			u32 entries, blockTable, sets, strings;
+		};
+
+		struct DomainEntry {
+			u32 id, name;
+		};
+
+		struct BlockEntry {
+			u32 name, in, out;
+		};
+	}
+
+	// builds one function record
+	class RecordWriter {
+		public:
+		RecordWriter (results::RecordKind kind, StringRef function, unsigned transfers);
+
+		void value (unsigned id, StringRef name);
+		// blocks in function order, sets over the domain given so far
+		void block (StringRef name, const BitVector &in, const BitVector &out);
+		void write (raw_ostream &OS);
+
+		// the record naming the file the functions after it come from
+		static void writeFile (raw_ostream &OS, StringRef path);
+
+		private:
+		unsigned string (StringRef str);
+		void runs (const BitVector &set);
+
+		results::RecordKind kind;
+		unsigned name, transfers;
+		SmallVector<results::DomainEntry, 64> entries;
+		SmallVector<results::BlockEntry, 64> blocks;
+		SmallVector<char, 1024> sets;
+		SmallVector<char, 1024> strings;
+		BitVector delta;
+	};
+
+	// one record of a mapped file, its tables point into the file
+	class ResultRecord {
+		public:
+		ResultRecord (const results::RecordHeader *header) : header(header) {}
+
+		results::RecordKind kind () const { return (results::RecordKind) (unsigned) header->kind; }
+		bool isFile () const { return kind() == results::FILE_RECORD; }
+		size_t size () const { return header->size; }
+
+		// the file name of a file record, the function name of the others
+		StringRef name () const;
+
+		unsigned blocks () const { return isFile() ? 0 : function()->blocks; }
+		unsigned domain () const { return isFile() ? 0 : function()->domain; }
+		unsigned transfers () const { return isFile() ? 0 : function()->transfers; }
+		unsigned valueId (unsigned i) const { return entries()[i].id; }
+		StringRef valueName (unsigned i) const { return string(entries()[i].name); }
+		StringRef blockName (unsigned b) const { return string(blockTable()[b].name); }
+
+		// decode the sets of block b into set, resized to the domain. Records
+		// of a ResultFile had their runs checked when it was opened
+		void in (unsigned b, BitVector &set) const;
+		void out (unsigned b, BitVector &set) const;
+
+		private:
+		friend class ResultFile;
+
+		const char *base () const { return reinterpret_cast<const char *>(header); }
+		const results::FunctionHeader *function () const {
+			return reinterpret_cast<const results::FunctionHeader *>(header + 1);
+		}
+		const results::DomainEntry *entries () const {
+			return reinterpret_cast<const results::DomainEntry *>(base() + function()->entries);
+		}
+		const results::BlockEntry *blockTable () const {
+			return reinterpret_cast<const results::BlockEntry *>(base() + function()->blockTable);
+		}
+		StringRef string (unsigned offset) const;
+		// the tables, offsets and set runs stay inside the record
+		Error check () const;
+
+		const results::RecordHeader *header;
+	};
+
+	// a mapped result file. Opening checks the headers, tables and set runs
+	// of every record, names and sets are decoded only when used
+	class ResultFile {
+		public:
+		static Expected<std::unique_ptr<ResultFile>> open (StringRef path);
+
+		const std::vector<ResultRecord> &records () const { return all; }
+		size_t bytes () const { return buffer->getBufferSize(); }
+
+		private:
+		ResultFile (std::unique_ptr<MemoryBuffer> buffer) : buffer(std::move(buffer)) {}
+
+		std::unique_ptr<MemoryBuffer> buffer;
+		std::vector<ResultRecord> all;
+	};
+};
+
+#endif
@@ -0,0 +1,530 @@
+#ifndef DATAFLOW_SOLVER_H
+#define DATAFLOW_SOLVER_H
+
+#include "Dataflow.h"
+#include "BitKernels.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+
+#include <queue>
+
+namespace llvm {
+	// meet operators, in place
+	struct UnionMeet {
+		static const MeetOp op = UNION;
+		static void meet (VSet &into, const VSet &from) { into |= from; }
+	};
+
+	struct IntersectMeet {
+		static const MeetOp op = INTERSECT;
+		static void meet (VSet &into, const VSet &from) { into &= from; }
+	};
+
+	// dataflow solver specialized at compile time on the direction, the meet
+	// operator, the lattice and the transfer policy, so the inner loop has no
+	// virtual calls or runtime switches. A Transfer provides
+	//
+	//   Lattice emptySet ()
+	//     value of a block nothing flows into
+	//   void fit (Lattice &value)
+	//     bring a value from an earlier run up to the current domain
+	//   void invalidate (Function &F, ArrayRef<BasicBlock*> stale)
+	//     forget what it cached for blocks that were edited, added or deleted
+	//   size_t bytesUsed ()
+	//     memory it keeps, counted into the result
+	//   template<typename Meet> bool meetTransfer (BasicBlock *BB,
+	//       ArrayRef<const Lattice*> inputs, Lattice &input, Lattice &output,
+	//       std::map<BasicBlock*, Lattice> &neighbor)
+	//     meet inputs into the block's input, then update its output and edge
+	//     facts in place, true if either changed. Bit-set transfers do both
+	//     in one pass with the kernels of BitKernels.h
+	//
+	// Values live in the per-block storage of the result and are overwritten
+	// in place, so a solve allocates nothing once every block has been seen.
+	// Facts a block passes along a single edge are or'ed into the value seen
+	// by that neighbor, so the lattice needs |=. Lattice is a VSet or, for
+	// facts that are not sets, a LatticeVector (Lattice.h), whose |= joins
+	template<Direction Dir, typename Meet, typename Transfer, typename Lattice = VSet>
+	class DataflowSolver {
+		public:
+		typedef DataFlowResultOf<Lattice> Result;
+
+		// name tells the analysis apart in the instrumentation reports
+		DataflowSolver (Transfer &transfer, Solver solver = WORKLIST, const char *name = "dataflow")
+		: transfer(transfer), solver(solver), name(name), blocks(ArenaAllocator<BasicBlock*>(arena)),
+		neighbors(arena), dependents(arena), boundaryBlocks(ArenaAllocator<bool>(arena))
+		{
+
+		};
+
+		Result run (Function &F, Lattice boundary, Lattice interior);
+		// same contract as Dataflow::rerun
+		Result rerun (Function &F, const Result &previous,
+			const std::set<BasicBlock*> &changed, Lattice boundary, Lattice interior);
+
+		private:
+		typedef BlockResultOf<Lattice> Block;
+		typedef std::vector<Block> Values;
+
+		// the side of a block the meet writes, and the side the transfer writes
+		static Lattice &input (Block &block) { return Dir == FORWARD ? block.in : block.out; }
+		static Lattice &output (Block &block) { return Dir == FORWARD ? block.out : block.in; }
+		// blocks the boundary condition applies to: the entry going FORWARD,
+		// every block without successors (return, unreachable) going BACKWARD
+		static bool isBoundary (Function &F, BasicBlock *BB) {
+			return Dir == FORWARD ? BB == &F.front() : succ_empty(BB);
+		}
+
+		bool update (unsigned currBB, Values &values, const Lattice &base);
+		bool sameNeighbors (unsigned currBB, const Result &previous) const;
+		unsigned solveRoundRobin (ArrayRef<unsigned> traverseList,
+			Values &values, const Lattice &base);
+		unsigned solveWorklist (ArrayRef<unsigned> traverseList,
+			Values &values, const Lattice &base);
+
+		Transfer &transfer;
+		Solver solver;
+		const char *name;
+		// counters of the solve in progress, null unless instrumenting
+		SolverStats *stats = nullptr;
+		// every table of a run lives in the arena, which is reset in one shot
+		// when the next run starts
+		BumpPtrAllocator arena;
+		// the function being solved: its blocks by number, their neighbors along
+		// the direction, the blocks that read each block, and the boundary ones
+		ArenaVector<BasicBlock*> blocks;
+		BlockEdges neighbors, dependents;
+		ArenaVector<bool> boundaryBlocks;
+		// value of a block nothing flows into
+		Lattice empty;
+		// what flows into the block being updated, and room to add edge facts
+		// to a neighbor's output without touching it. A deque, so pointers to
+		// its values stay put while it grows
+		SmallVector<const Lattice*, 8> meetInputs;
+		std::deque<Lattice> edgeValues;
+	};
+
+	// edge facts do not depend on the input, they only change once
+	inline bool edgeTransfer (const BlockSummary &summary,
+		std::map<BasicBlock*, VSet> &neighbor) {
+		if (neighbor != summary.neighbor) {
+			neighbor = summary.neighbor;
+			return true;
+		}
+		return false;
+	}
+
+	// (input - kill) U gen, written over the old output word by word
+	inline bool genKillTransfer (const BlockSummary &summary, const VSet &input,
+		VSet &output, std::map<BasicBlock*, VSet> &neighbor) {
+		bool changed = genKill(input, summary.gen, summary.kill, output);
+		changed |= edgeTransfer(summary, neighbor);
+		return changed;
+	}
+
+	// drop the summaries of stale blocks and of blocks that left F
+	inline void invalidateSummaries (DenseMap<BasicBlock*, BlockSummary> &summaries,
+		Function &F, ArrayRef<BasicBlock*> stale) {
+		for (auto BB : stale) {
+			summaries.erase(BB);
+		}
+
+		SmallPtrSet<BasicBlock*, 32> blocks;
+		for (auto &BB : F) {
+			blocks.insert(&BB);
+		}
+		for (auto it = summaries.begin(); it != summaries.end();) {
+			auto curr = it++;
+			if (!blocks.count(curr->first)) {
+				summaries.erase(curr);
+			}
+		}
+	}
+
+	inline size_t summaryBytes (const DenseMap<BasicBlock*, BlockSummary> &summaries) {
+		size_t bytes = capacity_in_bytes(summaries);
+		for (auto &summary : summaries) {
+			bytes += capacity_in_bytes(summary.second);
+		}
+		return bytes;
+	}
+
+	// transfer policy for gen/kill problems over bit sets, Derived provides
+	//
+	//   BlockSummary summarize (BasicBlock *BB)
+	//
+	// nothing in a summary depends on the input, so each block is summarized
+	// once and kept until it is invalidated
+	template<typename Derived> class GenKillTransfer {
+		public:
+		GenKillTransfer (const Domain &domain) : domain(domain) {}
+
+		// empty and universal set sized from the domain
+		VSet emptySet () const { return VSet(domain.size()); }
+		VSet fullSet () const { return VSet(domain.size(), true); }
+		void fit (VSet &value) const { value.resize(domain.size()); }
+		Index domainIndex (const Value* val) const { return domain.find(val); }
+		static const Index INDEX_NOT_FOUND = Domain::NOT_FOUND;
+
+		void invalidate (Function &F, ArrayRef<BasicBlock*> stale) {
+			invalidateSummaries(summaries, F, stale);
+		}
+
+		size_t bytesUsed () const {
+			return summaryBytes(summaries);
+		}
+
+		// the meet, kill and gen of a block in one pass over its words
+		template<typename Meet> bool meetTransfer (BasicBlock *BB, ArrayRef<const VSet*> inputs,
+			VSet &input, VSet &output, std::map<BasicBlock*, VSet> &neighbor) {
+			auto summary = summaries.find(BB);
+			if (summary == summaries.end()) {
+				BlockSummary built = static_cast<Derived*>(this)->summarize(BB);
+				summary = summaries.insert(std::make_pair(BB, std::move(built))).first;
+			}
+
+			const BlockSummary &facts = summary->second;
+			bool changed = meetGenKill(Meet::op, inputs, facts.gen, facts.kill, input, output);
+			changed |= edgeTransfer(facts, neighbor);
+			return changed;
+		}
+
+		protected:
+		const Domain &domain;
+
+		private:
+		DenseMap<BasicBlock*, BlockSummary> summaries;
+	};
+
+	template<Direction Dir, typename Meet, typename Transfer, typename Lattice>
+	DataFlowResultOf<Lattice> DataflowSolver<Dir, Meet, Transfer, Lattice>::run (
+		Function &F, Lattice boundary, Lattice interior) {
+		// a first run is a re-run where nothing is known, every block is new
+		return rerun(F, Result(), std::set<BasicBlock*>(), boundary, interior);
+	}
+
+	template<Direction Dir, typename Meet, typename Transfer, typename Lattice>
+	DataFlowResultOf<Lattice> DataflowSolver<Dir, Meet, Transfer, Lattice>::rerun (
+		Function &F, const Result &previous, const std::set<BasicBlock*> &changed,
+		Lattice boundary, Lattice interior) {
+		TimeTraceScope trace("dataflow solve", [&]() { return (Twine(name) + " " + F.getName()).str(); });
+		SolverStats record;
+		std::chrono::steady_clock::time_point start;
+		stats = instrumenting() ? &record : nullptr;
+		if (stats) {
+			start = std::chrono::steady_clock::now();
+		}
+
+		// the tables of the previous run go away in one shot
+		blocks = ArenaVector<BasicBlock*>(blocks.get_allocator());
+		neighbors = BlockEdges(arena);
+		dependents = BlockEdges(arena);
+		boundaryBlocks = ArenaVector<bool>(boundaryBlocks.get_allocator());
+		arena.Reset();
+		ArenaAllocator<unsigned> tables(arena);
+
+		Result analysis;
+		analysis.numberBlocks(F);
+		blocks.assign(analysis.blocks.begin(), analysis.blocks.end());
+		Values &values = analysis.values;
+		unsigned size = analysis.size();
+
+		// every value in this run is over the current domain
+		transfer.fit(boundary);
+		transfer.fit(interior);
+		empty = transfer.emptySet();
+
+		// neighbors are predecessors going FORWARD and successors going BACKWARD
+		neighbors.start.reserve(size + 1);
+		neighbors.start.push_back(0);
+		boundaryBlocks.assign(size, false);
+		for (unsigned i = 0; i < size; ++i) {
+			BasicBlock *BB = blocks[i];
+			if (Dir == FORWARD) {
+				for (auto pred_BB = pred_begin(BB); pred_BB != pred_end(BB); ++pred_BB) {
+					neighbors.targets.push_back(analysis.number(*pred_BB));
+				}
+			} else {
+				for (auto succ_BB = succ_begin(BB); succ_BB != succ_end(BB); ++succ_BB) {
+					neighbors.targets.push_back(analysis.number(*succ_BB));
+				}
+			}
+			neighbors.start.push_back(neighbors.targets.size());
+
+			boundaryBlocks[i] = isBoundary(F, BB);
+		}
+
+		// blocks that have to be revisited once a block's output changes
+		dependents = neighbors.reverse();
+
+		analysis.neighborStart.assign(neighbors.start.begin(), neighbors.start.end());
+		analysis.neighborTargets.assign(neighbors.targets.begin(), neighbors.targets.end());
+
+		// whatever the transfer cached for edited, added or removed blocks is
+		// stale. A block that only gained or lost a neighbor, like the target
+		// of a removed edge, keeps its cache but meets different values. New
+		// blocks are told apart from removed ones at the same address by
+		// their terminator
+		ArenaVector<BasicBlock*> stale(tables);
+		ArenaVector<unsigned> pending(tables);
+		for (unsigned i = 0; i < size; ++i) {
+			if (changed.count(blocks[i]) || !previous.sameBlock(blocks[i])) {
+				stale.push_back(blocks[i]);
+				pending.push_back(i);
+			} else if (!sameNeighbors(i, previous)) {
+				pending.push_back(i);
+			}
+		}
+		transfer.invalidate(F, stale);
+
+		// everything downstream of a changed or new block may change too. Those
+		// blocks restart from the initial values, so stale facts can not keep
+		// themselves alive around a loop, the rest keep their previous result
+		ArenaVector<bool> affected(size, false, tables);
+		while (!pending.empty()) {
+			unsigned BB = pending.back();
+			pending.pop_back();
+			if (affected[BB]) {
+				continue;
+			}
+			affected[BB] = true;
+			for (auto dep : dependents[BB]) {
+				pending.push_back(dep);
+			}
+		}
+
+		// boundary blocks go first, every other block is a root as well, so
+		// blocks the boundary does not reach (dead code, infinite loops) are
+		// still solved. Values are built in the result, not copied into it
+		ArenaVector<unsigned> roots(tables), traverseList(tables);
+		for (unsigned i = 0; i < size; ++i) {
+			if (affected[i] && boundaryBlocks[i]) {
+				input(values[i]) = boundary;
+				output(values[i]) = empty;
+				roots.push_back(i);
+			}
+		}
+		for (unsigned i = 0; i < size; ++i) {
+			if (!affected[i]) {
+				// the domain may have grown since the previous run
+				Block &kept = values[i];
+				kept = previous.at(blocks[i]);
+				transfer.fit(kept.in);
+				transfer.fit(kept.out);
+				for (auto &edge : kept.transferOutput.neighbor) {
+					transfer.fit(edge.second);
+				}
+			} else if (!boundaryBlocks[i]) {
+				input(values[i]) = empty;
+				output(values[i]) = interior;
+				roots.push_back(i);
+			}
+		}
+
+		// reverse postorder along the direction, loops innermost-first
+		orderBlocks(roots, dependents, traverseList);
+		if (stats) {
+			record.blockTransfers.assign(size, 0);
+		}
+
+		if (solver == ROUND_ROBIN) {
+			analysis.transferCount = solveRoundRobin(traverseList, values, boundary);
+		} else if (reportSavings()) {
+			// the round-robin solve is only needed to report what we saved
+			Values scratch = values;
+			SolverStats *counting = stats;
+			stats = nullptr;
+			unsigned roundRobin = solveRoundRobin(traverseList, scratch, boundary);
+			stats = counting;
+			analysis.transferCount = solveWorklist(traverseList, values, boundary);
+			errs() << "dataflow: " << F.getName() << ": " << analysis.transferCount
+				<< " transfer evaluations, round-robin needs " << roundRobin
+				<< ", saved " << (int) (roundRobin - analysis.transferCount) << "\n";
+		} else {
+			analysis.transferCount = solveWorklist(traverseList, values, boundary);
+		}
+
+		analysis.bytesUsed = arena.getBytesAllocated() + transfer.bytesUsed()
+			+ capacity_in_bytes(analysis.numbers) + values.capacity() * sizeof(Block)
+			+ (analysis.neighborStart.capacity() + analysis.neighborTargets.capacity()) * sizeof(unsigned)
+			+ analysis.terminators.capacity() * sizeof(const Instruction*);
+		for (auto &block : values) {
+			analysis.bytesUsed += capacity_in_bytes(block.in) + capacity_in_bytes(block.out);
+			for (auto &edge : block.transferOutput.neighbor) {
+				analysis.bytesUsed += capacity_in_bytes(edge.second);
+			}
+		}
+		if (reportMemory()) {
+			errs() << "dataflow: " << F.getName() << ": " << analysis.bytesUsed
+				<< " bytes, " << arena.getBytesAllocated() << " in solver tables\n";
+		}
+
+		if (stats) {
+			for (auto &block : values) {
+				for (const Lattice *set : {&block.in, &block.out}) {
+					unsigned bits = set->count();
+					record.setBits += bits;
+					record.maxSetBits = std::max(record.maxSetBits, bits);
+				}
+			}
+			record.transfers = analysis.transferCount;
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			record.seconds = elapsed.count();
+			stats = nullptr;
+			reportSolve(name, F, record);
+		}
+
+		return analysis;
+	}
+
+	// meet the neighbors of one block into its input and apply its transfer
+	// function, return true if its output changed
+	template<Direction Dir, typename Meet, typename Transfer, typename Lattice>
+	bool DataflowSolver<Dir, Meet, Transfer, Lattice>::update (unsigned currBB,
+		Values &values, const Lattice &base) {
+		Block &block = values[currBB];
+		BasicBlock *BB = blocks[currBB];
+
+		// gather what flows in, the transfer meets it and applies itself in
+		// one pass
+		meetInputs.clear();
+		unsigned edges = 0;
+
+		// if we have to initialize with some values
+		if (boundaryBlocks[currBB]) {
+			meetInputs.push_back(&base);
+		}
+
+		for (auto n : neighbors[currBB]) {
+			Block &neighbor = values[n];
+
+			// facts the neighbor only passes along the edge to us, most
+			// blocks have none
+			auto &edge = neighbor.transferOutput.neighbor;
+			auto edgeFacts = edge.empty() ? edge.end() : edge.find(BB);
+			if (edgeFacts != edge.end()) {
+				if (edges == edgeValues.size()) {
+					edgeValues.push_back(empty);
+				}
+				Lattice &edgeValue = edgeValues[edges++];
+				edgeValue = output(neighbor);
+				edgeValue |= edgeFacts->second;
+				meetInputs.push_back(&edgeValue);
+			} else {
+				meetInputs.push_back(&output(neighbor));
+			}
+		}
+
+		if (meetInputs.empty()) {
+			meetInputs.push_back(&empty);
+		}
+		if (stats) {
+			stats->blockTransfers[currBB]++;
+			stats->meets += meetInputs.size() - 1;
+		}
+
+		// then is transfer value
+		return transfer.template meetTransfer<Meet>(BB, meetInputs, input(block),
+			output(block), block.transferOutput.neighbor);
+	}
+
+	// whether a block meets the same blocks, in the same order, as in the
+	// previous run. Without the previous edges every block may have changed
+	template<Direction Dir, typename Meet, typename Transfer, typename Lattice>
+	bool DataflowSolver<Dir, Meet, Transfer, Lattice>::sameNeighbors (unsigned currBB,
+		const Result &previous) const {
+		if (!previous.hasNeighbors()) {
+			return false;
+		}
+		ArrayRef<unsigned> before = previous.neighbors(previous.number(blocks[currBB]));
+		ArrayRef<unsigned> now = neighbors[currBB];
+		if (before.size() != now.size()) {
+			return false;
+		}
+		for (unsigned i = 0; i < now.size(); ++i) {
+			if (previous.blocks[before[i]] != blocks[now[i]]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// fixed point algorithm, iterate over all blocks until nothing changes
+	template<Direction Dir, typename Meet, typename Transfer, typename Lattice>
+	unsigned DataflowSolver<Dir, Meet, Transfer, Lattice>::solveRoundRobin (
+		ArrayRef<unsigned> traverseList, Values &values, const Lattice &base) {
+		unsigned transferCount = 0;
+		bool converged = false;
+		while (!converged) {
+			converged = true;
+			if (stats) {
+				stats->rounds++;
+			}
+
+			for (auto currBB : traverseList) {
+				if (update(currBB, values, base)) {
+					converged = false;
+				}
+				transferCount++;
+			}
+		}
+
+		return transferCount;
+	}
+
+	// worklist algorithm, only revisit the dependents of a block whose output changed
+	template<Direction Dir, typename Meet, typename Transfer, typename Lattice>
+	unsigned DataflowSolver<Dir, Meet, Transfer, Lattice>::solveWorklist (
+		ArrayRef<unsigned> traverseList, Values &values, const Lattice &base) {
+		unsigned transferCount = 0;
+		ArenaAllocator<unsigned> tables(arena);
+
+		ArenaVector<unsigned> position(blocks.size(), 0, tables);
+		for (unsigned i = 0; i < traverseList.size(); ++i) {
+			position[traverseList[i]] = i;
+		}
+
+		// every block has to be evaluated at least once. Always take the earliest
+		// pending block in traverse order, so a loop stabilizes before the solver
+		// moves past it. A block is queued at most once, so the heap never
+		// grows past its reserved size
+		ArenaVector<unsigned> heap(tables);
+		heap.reserve(traverseList.size());
+		std::priority_queue<unsigned, ArenaVector<unsigned>, std::greater<unsigned>>
+			pending(std::greater<unsigned>(), std::move(heap));
+		ArenaVector<bool> queued(traverseList.size(), true, tables);
+		for (unsigned i = 0; i < traverseList.size(); ++i) {
+			pending.push(i);
+		}
+
+		unsigned last = 0;
+		while (!pending.empty()) {
+			unsigned next = pending.top();
+			pending.pop();
+			queued[next] = false;
+			// going back to an earlier block starts another round
+			if (stats && (transferCount == 0 || next <= last)) {
+				stats->rounds++;
+			}
+			last = next;
+			unsigned currBB = traverseList[next];
+
+			transferCount++;
+			if (!update(currBB, values, base)) {
+				continue;
+			}
+
+			for (auto BB : dependents[currBB]) {
+				unsigned i = position[BB];
+				if (!queued[i]) {
+					queued[i] = true;
+					pending.push(i);
+				}
+			}
+		}
+
+		return transferCount;
+	}
+};
+
+#endif
@@ -0,0 +1,323 @@
+#include "Passes.h"
+
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <random>
+
+using namespace llvm;
+namespace {
+    static cl::list<unsigned> Blocks("blocks", cl::CommaSeparated,
+        cl::desc("Blocks per generated function, one run per size (default 100,1000,10000)"));
+
+    static cl::opt<unsigned> Depth("depth",
+        cl::desc("Deepest loop nesting of the generated functions"),
+        cl::init(3));
+
+    static cl::opt<unsigned> Values("values",
+        cl::desc("Binary operators computed in every block"),
+        cl::init(8));
+
+    static cl::opt<unsigned> Variables("variables",
+        cl::desc("Mutable variables the blocks read and write"),
+        cl::init(16));
+
+    static cl::opt<double> PhiDensity("phis",
+        cl::desc("Chance a computed value is written back to a variable, "
+            "which turns into PHIs where control flow joins"),
+        cl::init(0.25));
+
+    static cl::opt<unsigned> Functions("functions",
+        cl::desc("Functions generated per size"),
+        cl::init(4));
+
+    static cl::opt<unsigned> Repeat("repeat",
+        cl::desc("Times every function is solved by each analysis"),
+        cl::init(3));
+
+    static cl::opt<unsigned> Seed("seed",
+        cl::desc("Seed of the generator, the same seed gives the same functions"),
+        cl::init(1));
+
+    enum Format {
+        TSV,
+        JSON
+    };
+
+    static cl::opt<Format> OutputFormat("format",
+        cl::desc("Report format"),
+        cl::values(
+            clEnumValN(TSV, "tsv", "a header line and one tab-separated row per run"),
+            clEnumValN(JSON, "json", "one JSON object per run")),
+        cl::init(TSV));
+
+    static cl::opt<std::string> OutputFile("o",
+        cl::desc("Write the report here instead of stdout"),
+        cl::value_desc("file"), cl::init("-"));
+
+    static cl::opt<std::string> TimeTrace("time-trace",
+        cl::desc("Write a Chrome trace of the domain, solve and print phases to this file"),
+        cl::value_desc("file"), cl::init(""));
+
+    // structured control flow with loops nested up to Depth. Every block
+    // computes Values operators over variables, arguments and its own
+    // results, and writes some of them back to variables. The variables
+    // start out as allocas, promoting them places the PHIs
+    class Generator {
+        public:
+        Generator (Module &M, unsigned seed) : M(M), rng(seed) {}
+
+        Function *generate (const std::string &name, unsigned blocks) {
+            LLVMContext &context = M.getContext();
+            Type *i32 = Type::getInt32Ty(context);
+            FunctionType *type = FunctionType::get(i32, {i32, i32, i32, i32}, false);
+            F = Function::Create(type, Function::ExternalLinkage, name, M);
+
+            BasicBlock *entry = BasicBlock::Create(context, "entry", F);
+            IRBuilder<> builder(entry);
+            variables.clear();
+            for (unsigned i = 0; i < std::max(1u, (unsigned) Variables); ++i) {
+                variables.push_back(builder.CreateAlloca(i32));
+            }
+            for (unsigned i = 0; i < variables.size(); ++i) {
+                builder.CreateStore(F->getArg(i % F->arg_size()), variables[i]);
+            }
+
+            BasicBlock *exit = region(entry, 0, blocks > 1 ? blocks - 1 : 0);
+            fill(exit);
+            IRBuilder<>(exit).CreateRet(read(exit));
+
+            DominatorTree DT(*F);
+            PromoteMemToReg(variables, DT);
+            if (verifyFunction(*F, &errs())) {
+                report_fatal_error("generated function is broken");
+            }
+            return F;
+        }
+
+        private:
+        BasicBlock *newBlock () {
+            return BasicBlock::Create(M.getContext(), "", F);
+        }
+
+        // any variable or argument, loaded at the end of BB
+        Value *read (BasicBlock *BB) {
+            IRBuilder<> builder(BB);
+            if (rng() % 8 == 0) {
+                return F->getArg(rng() % F->arg_size());
+            }
+            return builder.CreateLoad(builder.getInt32Ty(), variables[rng() % variables.size()]);
+        }
+
+        void fill (BasicBlock *BB) {
+            static const Instruction::BinaryOps ops[] = {
+                Instruction::Add, Instruction::Sub, Instruction::Mul,
+                Instruction::Xor, Instruction::And
+            };
+
+            IRBuilder<> builder(BB);
+            std::vector<Value*> local;
+            auto operand = [&]() {
+                if (!local.empty() && rng() % 2) {
+                    return local[rng() % local.size()];
+                }
+                return read(BB);
+            };
+
+            for (unsigned i = 0; i < Values; ++i) {
+                Value *value = builder.CreateBinOp(ops[rng() % 5], operand(), operand());
+                local.push_back(value);
+                if (std::uniform_real_distribution<double>(0, 1)(rng) < PhiDensity) {
+                    builder.CreateStore(value, variables[rng() % variables.size()]);
+                }
+            }
+        }
+
+        Value *condition (BasicBlock *BB) {
+            IRBuilder<> builder(BB);
+            return builder.CreateICmpSLT(read(BB), builder.getInt32(rng() % 64));
+        }
+
+        // lay out about `budget` blocks after curr, return the block control
+        // leaves the region from, still without a terminator
+        BasicBlock *region (BasicBlock *curr, unsigned depth, unsigned budget) {
+            while (budget > 0) {
+                fill(curr);
+                unsigned pick = rng() % 4;
+                if (pick < 2 && depth < Depth && budget >= 3) {
+                    // header, a nested body, back to the header or out
+                    unsigned inner = 1 + rng() % (budget - 2);
+                    BasicBlock *header = newBlock(), *body = newBlock(), *exit = newBlock();
+                    IRBuilder<>(curr).CreateBr(header);
+                    fill(header);
+                    IRBuilder<>(header).CreateCondBr(condition(header), body, exit);
+                    BasicBlock *latch = region(body, depth + 1, inner - 1);
+                    fill(latch);
+                    IRBuilder<>(latch).CreateBr(header);
+                    budget -= inner + 2;
+                    curr = exit;
+                } else if (pick == 2 && budget >= 3) {
+                    // a diamond
+                    unsigned inner = budget - 3;
+                    BasicBlock *left = newBlock(), *right = newBlock(), *join = newBlock();
+                    IRBuilder<>(curr).CreateCondBr(condition(curr), left, right);
+                    unsigned share = rng() % (inner + 1);
+                    unsigned leftShare = share / 2, rightShare = share - leftShare;
+                    BasicBlock *leftEnd = region(left, depth, leftShare);
+                    fill(leftEnd);
+                    IRBuilder<>(leftEnd).CreateBr(join);
+                    BasicBlock *rightEnd = region(right, depth, rightShare);
+                    fill(rightEnd);
+                    IRBuilder<>(rightEnd).CreateBr(join);
+                    budget -= share + 3;
+                    curr = join;
+                } else {
+                    BasicBlock *next = newBlock();
+                    IRBuilder<>(curr).CreateBr(next);
+                    budget--;
+                    curr = next;
+                }
+            }
+            return curr;
+        }
+
+        Module &M;
+        std::mt19937 rng;
+        Function *F;
+        std::vector<AllocaInst*> variables;
+    };
+
+    // one analysis over every function of a size
+    struct Measure {
+        const char *analysis;
+        double seconds;
+        uint64_t transfers;
+        size_t bytes;
+    };
+
+    template<typename Compute> Measure measure (const char *analysis,
+        ArrayRef<Function*> functions, Compute compute) {
+        Measure m = {analysis, 0, 0, 0};
+        for (auto F : functions) {
+            auto info = compute(*F);
+            m.transfers += info.getResult().transferCount;
+            m.bytes = std::max(m.bytes, info.getResult().bytesUsed);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned r = 0; r < Repeat; ++r) {
+            for (auto F : functions) {
+                compute(*F);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        m.seconds = elapsed.count() / std::max(1u, (unsigned) Repeat);
+        return m;
+    }
+
+    long maxRssKb () {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+}
+
+// dataflow-synth-bench: generate functions of growing size and time every
+// analysis on them. One row (or JSON object) per size and analysis, times
+// are seconds per solve of all the functions of that size
+int main (int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "dataflow synthetic CFG benchmark\n");
+
+    std::error_code EC;
+    ToolOutputFile out(OutputFile, EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << argv[0] << ": " << OutputFile << ": " << EC.message() << "\n";
+        return 1;
+    }
+    raw_ostream &OS = out.os();
+    if (!TimeTrace.empty()) {
+        timeTraceProfilerInitialize(0, argv[0]);
+    }
+
+    std::vector<unsigned> sizes(Blocks.begin(), Blocks.end());
+    if (sizes.empty()) {
+        sizes = {100, 1000, 10000};
+    }
+
+    if (OutputFormat == TSV) {
+        OS << "blocks\tdepth\tvalues\tphis\tfunctions\tinstructions\tphi_nodes\tanalysis"
+            << "\tseconds\ttransfers\tvisits_per_block\tpeak_bytes\tmaxrss_kb\n";
+    }
+
+    for (unsigned size : sizes) {
+        LLVMContext context;
+        Module M("synthetic", context);
+        Generator generator(M, Seed + size);
+
+        std::vector<Function*> functions;
+        uint64_t blocks = 0, insts = 0, phis = 0;
+        for (unsigned i = 0; i < Functions; ++i) {
+            Function *F = generator.generate("f" + std::to_string(i), size);
+            functions.push_back(F);
+            blocks += F->size();
+            for (auto &I : instructions(*F)) {
+                insts++;
+                phis += isa<PHINode>(&I);
+            }
+        }
+
+        Measure measures[] = {
+            measure("liveness", functions, [](Function &F) { return computeLiveness(F); }),
+            measure("reaching", functions, [](Function &F) { return computeReaching(F); }),
+            measure("available", functions, [](Function &F) { return computeAvailable(F); })
+        };
+
+        for (auto &m : measures) {
+            double visits = blocks ? (double) m.transfers / blocks : 0;
+            if (OutputFormat == JSON) {
+                json::Object row{
+                    {"blocks", (int64_t) size}, {"depth", (int64_t) Depth},
+                    {"values", (int64_t) Values}, {"phis", PhiDensity.getValue()},
+                    {"functions", (int64_t) Functions}, {"instructions", (int64_t) insts},
+                    {"phi_nodes", (int64_t) phis}, {"analysis", m.analysis},
+                    {"seconds", m.seconds}, {"transfers", (int64_t) m.transfers},
+                    {"visits_per_block", visits}, {"peak_bytes", (int64_t) m.bytes},
+                    {"maxrss_kb", (int64_t) maxRssKb()}
+                };
+                OS << json::Value(std::move(row)) << "\n";
+            } else {
+                OS << size << "\t" << Depth << "\t" << Values << "\t" << format("%.2f", PhiDensity.getValue())
+                    << "\t" << Functions << "\t" << insts << "\t" << phis
+                    << "\t" << m.analysis << "\t" << format("%.6f", m.seconds)
+                    << "\t" << m.transfers << "\t" << format("%.2f", visits)
+                    << "\t" << m.bytes << "\t" << maxRssKb() << "\n";
+            }
+        }
+    }
+
+    if (!TimeTrace.empty()) {
+        if (Error E = timeTraceProfilerWrite(TimeTrace, OutputFile)) {
+            logAllUnhandledErrors(std::move(E), errs(), argv[0]);
+            return 1;
+        }
+        timeTraceProfilerCleanup();
+    }
+
+    out.keep();
+    return 0;
+}